@@ -0,0 +1,343 @@
+// Headless noise baker: evaluates the CPU noise over a 2D image or a 3D
+// volume on all cores and writes it to disk. No GL/GLUT dependency.
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+
+#include "Vec3D.h"
+#include "Noise.h"
+#include "Perlin.h"
+#include "Gabor.h"
+#include "Parallel.h"
+
+using namespace std;
+
+typedef enum {PPM, PFM, Raw} Format;
+typedef enum {WaveletNoise, PerlinNoise, GaborNoise} NoiseType;
+
+static unsigned int width = 512, height = 512, depth = 1;
+static NoiseType noiseType = WaveletNoise;
+static float noiseExtent = 0.f; // 0 = default of the noise type
+static float sliceZ = 0.f;
+static Format format = PPM;
+static string output;
+
+// wavelet properties
+static int tileSize = 32;
+static float gaussianClamp = 4.f;
+static unsigned int seed = 0;
+static int nbands = 5;
+static int firstBand = -5;
+static float s = 0.f;
+static bool noiseProjected = false;
+static float (*weights) (unsigned int) = Noise::octave;
+
+// perlin properties
+static int nbOctave = 4;
+static float persistence = 0.5f;
+static float f0 = 1.f;
+static float perlinTime = 0.f;
+static Perlin::Basis perlinBasis = Perlin::Value;
+typedef enum {Cosine, Cubic, Quintic, TableCosine} InterpolationType;
+static InterpolationType interpolation = Cosine;
+
+// gabor properties
+static Gabor gabor;
+static bool gaborSolid = false;
+
+void printUsage () {
+	cerr << endl
+		<< "--------------------------------------" << endl
+		<< "noisebake" << endl
+		<< "--------------------------------------" << endl
+		<< "USAGE: ./noisebake [options] <output>.{ppm,pfm,raw}" << endl
+		<< "--------------------------------------" << endl
+		<< " -size WxH | WxHxD  image or volume size (default 512x512)" << endl
+		<< " -format ppm|pfm|raw  output format (default from extension)" << endl
+		<< " -noise wavelet|perlin|gabor  noise to bake (default wavelet)" << endl
+		<< " -extent e          noise units across the image" << endl
+		<< "                    (default 100 for wavelet, 4 for perlin, 1000 for gabor)" << endl
+		<< " -z z               z of a 2D slice, in noise units (default 0)" << endl
+		<< " -threads n         worker threads (default: all cores)" << endl
+		<< endl
+		<< " -tile n            wavelet tile size (default 32)" << endl
+		<< " -clamp c           wavelet gaussian clamp (default 4)" << endl
+		<< " -seed n            wavelet tile seed (default 0)" << endl
+		<< " -bands n           number of bands (default 5)" << endl
+		<< " -firstband b       first band (default -5)" << endl
+		<< " -s s               band cut-off s (default 0)" << endl
+		<< " -weights octave|constant|invlinear|linear  band weights" << endl
+		<< " -projected         project the noise on the z=const plane" << endl
+		<< endl
+		<< " -octave n          (perlin) last octave (default 4)" << endl
+		<< " -persistence p     (perlin) persistence (default 0.5)" << endl
+		<< " -f0 f              (perlin) base frequency (default 1)" << endl
+		<< " -time t            (perlin) 4th coordinate (default 0)" << endl
+		<< " -simplex           (perlin) simplex instead of value noise" << endl
+		<< " -interpolation cosine|cubic|quintic|table  (perlin) value noise blend" << endl
+		<< endl
+		<< " -K k               (gabor) kernel magnitude (default 1)" << endl
+		<< " -a a               (gabor) kernel bandwidth (default 0.05)" << endl
+		<< " -F0 f              (gabor) kernel frequency (default 0.0625)" << endl
+		<< " -omega w           (gabor) orientation, with -aniso (default 0)" << endl
+		<< " -aniso             (gabor) anisotropic noise" << endl
+		<< " -impulses n        (gabor) impulses per kernel (default 64)" << endl
+		<< " -stratified        (gabor) a fixed jittered grid of impulses per cell" << endl
+		<< " -solid             (gabor) 3D noise, the slices of a volume differ" << endl
+		<< endl
+		<< " PPM maps [-1,1] to [0,255]; PFM and raw keep the floats." << endl
+		<< " Gabor noise is divided by 3 standard deviations, like the shader." << endl
+		<< " Volumes (D > 1) are written as raw float32, x fastest." << endl
+		<< "--------------------------------------" << endl;
+}
+
+void usage () {
+	printUsage ();
+	exit (EXIT_FAILURE);
+}
+
+bool endsWith (const string & str, const string & suffix) {
+	return str.size () >= suffix.size ()
+		&& str.compare (str.size () - suffix.size (), suffix.size (), suffix) == 0;
+}
+
+void parseArguments (int argc, char ** argv) {
+	bool formatSet = false;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if (arg == "-size" && hasValue) {
+			depth = 1;
+			if (sscanf (argv[++i], "%ux%ux%u", &width, &height, &depth) < 2)
+				usage ();
+		} else if (arg == "-format" && hasValue) {
+			string f = argv[++i];
+			formatSet = true;
+			if (f == "ppm") format = PPM;
+			else if (f == "pfm") format = PFM;
+			else if (f == "raw") format = Raw;
+			else usage ();
+		} else if (arg == "-noise" && hasValue) {
+			string n = argv[++i];
+			if (n == "wavelet") noiseType = WaveletNoise;
+			else if (n == "perlin") noiseType = PerlinNoise;
+			else if (n == "gabor") noiseType = GaborNoise;
+			else usage ();
+		} else if (arg == "-extent" && hasValue)
+			noiseExtent = atof (argv[++i]);
+		else if (arg == "-z" && hasValue)
+			sliceZ = atof (argv[++i]);
+		else if (arg == "-threads" && hasValue)
+			setThreadCount (atoi (argv[++i]));
+		else if (arg == "-tile" && hasValue)
+			tileSize = atoi (argv[++i]);
+		else if (arg == "-clamp" && hasValue)
+			gaussianClamp = atof (argv[++i]);
+		else if (arg == "-seed" && hasValue)
+			seed = strtoul (argv[++i], NULL, 10);
+		else if (arg == "-bands" && hasValue)
+			nbands = atoi (argv[++i]);
+		else if (arg == "-firstband" && hasValue)
+			firstBand = atoi (argv[++i]);
+		else if (arg == "-s" && hasValue)
+			s = atof (argv[++i]);
+		else if (arg == "-weights" && hasValue) {
+			string w = argv[++i];
+			if (w == "octave") weights = Noise::octave;
+			else if (w == "constant") weights = Noise::constant;
+			else if (w == "invlinear") weights = Noise::invLinear;
+			else if (w == "linear") weights = Noise::linear;
+			else usage ();
+		} else if (arg == "-projected")
+			noiseProjected = true;
+		else if (arg == "-octave" && hasValue)
+			nbOctave = atoi (argv[++i]);
+		else if (arg == "-persistence" && hasValue)
+			persistence = atof (argv[++i]);
+		else if (arg == "-f0" && hasValue)
+			f0 = atof (argv[++i]);
+		else if (arg == "-time" && hasValue)
+			perlinTime = atof (argv[++i]);
+		else if (arg == "-simplex")
+			perlinBasis = Perlin::Simplex;
+		else if (arg == "-interpolation" && hasValue) {
+			string n = argv[++i];
+			if (n == "cosine") interpolation = Cosine;
+			else if (n == "cubic") interpolation = Cubic;
+			else if (n == "quintic") interpolation = Quintic;
+			else if (n == "table") interpolation = TableCosine;
+			else usage ();
+		}
+		else if (arg == "-K" && hasValue)
+			gabor.K = atof (argv[++i]);
+		else if (arg == "-a" && hasValue)
+			gabor.a = atof (argv[++i]);
+		else if (arg == "-F0" && hasValue)
+			gabor.F0 = atof (argv[++i]);
+		else if (arg == "-omega" && hasValue)
+			gabor.omega0 = atof (argv[++i]);
+		else if (arg == "-aniso")
+			gabor.iso = false;
+		else if (arg == "-impulses" && hasValue)
+			gabor.impulsesPerKernel = atof (argv[++i]);
+		else if (arg == "-stratified")
+			gabor.stratified = true;
+		else if (arg == "-solid")
+			gaborSolid = true;
+		else if (arg[0] != '-' && output.empty ())
+			output = arg;
+		else
+			usage ();
+	}
+
+	if (output.empty () || !width || !height || !depth || tileSize < 2 || nbands < 1 || nbOctave < 0
+			|| gabor.a <= 0.f || gabor.impulsesPerKernel <= 0.f)
+		usage ();
+	if (noiseExtent <= 0.f)
+		noiseExtent = (noiseType == PerlinNoise) ? 4.f : (noiseType == GaborNoise) ? 1000.f : 100.f;
+	if (!formatSet) {
+		if (endsWith (output, ".pfm")) format = PFM;
+		else if (endsWith (output, ".raw")) format = Raw;
+		else format = PPM;
+	}
+	if (depth > 1 && format != Raw) {
+		cerr << "Volumes can only be written as raw float32" << endl;
+		exit (EXIT_FAILURE);
+	}
+}
+
+// Splits every slice into BLOCK x BLOCK pixel tiles handed out to the
+// worker threads; each tile goes through one batch call of evaluate
+// (x, y, z, normal x, normal y, normal z, result, count).
+#define BLOCK 64
+
+template <typename Evaluate>
+void bake (Evaluate evaluate, vector<float> & image) {
+	const unsigned int tilesX = (width+BLOCK-1)/BLOCK, tilesY = (height+BLOCK-1)/BLOCK;
+	const float step = noiseExtent / max (width, height);
+
+	parallelFor (tilesX*tilesY*depth, 1, [&] (unsigned int begin, unsigned int end) {
+		vector<float> x (BLOCK*BLOCK), y (BLOCK*BLOCK), z (BLOCK*BLOCK), value (BLOCK*BLOCK);
+		vector<float> nx (BLOCK*BLOCK, 0.f), ny (BLOCK*BLOCK, 0.f), nz (BLOCK*BLOCK, 1.f);
+		for (unsigned int tile = begin; tile < end; tile++) {
+			unsigned int tz = tile / (tilesX*tilesY);
+			unsigned int ty = tile / tilesX % tilesY, tx = tile % tilesX;
+			unsigned int x0 = tx*BLOCK, y0 = ty*BLOCK;
+			unsigned int w = min (BLOCK, (int) (width-x0)), h = min (BLOCK, (int) (height-y0));
+			float pz = (depth > 1) ? (tz+0.5f)*step : sliceZ;
+			unsigned int count = 0;
+			for (unsigned int j = 0; j < h; j++)
+				for (unsigned int i = 0; i < w; i++, count++) {
+					x[count] = (x0+i+0.5f)*step;
+					y[count] = (y0+j+0.5f)*step;
+					z[count] = pz;
+				}
+			evaluate (&x[0], &y[0], &z[0], &nx[0], &ny[0], &nz[0], &value[0], count);
+			float * slice = &image[(size_t) tz*width*height];
+			for (unsigned int j = 0, k = 0; j < h; j++)
+				for (unsigned int i = 0; i < w; i++, k++)
+					slice[(size_t) (y0+j)*width + x0+i] = value[k];
+		}
+	});
+}
+
+bool writeImage (const vector<float> & image) {
+	ofstream out (output.c_str (), ios::binary);
+	if (!out)
+		return false;
+	if (format == PPM) {
+		out << "P6\n" << width << " " << height << "\n255\n";
+		vector<unsigned char> row (3*width);
+		for (unsigned int j = 0; j < height; j++) {
+			for (unsigned int i = 0; i < width; i++) {
+				float v = 127.5f*(image[(size_t) j*width+i]+1.f);
+				row[3*i] = row[3*i+1] = row[3*i+2] =
+					(unsigned char) (v < 0.f ? 0.f : (v > 255.f ? 255.f : v + 0.5f));
+			}
+			out.write ((const char *) &row[0], row.size ());
+		}
+	} else if (format == PFM) {
+		// negative scale = little-endian; PFM rows go bottom to top
+		out << "Pf\n" << width << " " << height << "\n-1.0\n";
+		for (unsigned int j = height; j-- > 0; )
+			out.write ((const char *) &image[(size_t) j*width], width*sizeof (float));
+	} else
+		out.write ((const char *) &image[0], image.size ()*sizeof (float));
+	return bool (out);
+}
+
+int main (int argc, char ** argv) {
+	parseArguments (argc, argv);
+
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now (), tileDone = start;
+	vector<float> image ((size_t) width*height*depth);
+
+	if (noiseType == WaveletNoise) {
+		Wavelet wavelet (tileSize, seed, gaussianClamp);
+		wavelet.firstBand = firstBand;
+		wavelet.s = s;
+		wavelet.setW (nbands, weights);
+		const Wavelet::BandPlan plan = wavelet.bandPlan (noiseProjected);
+		tileDone = Clock::now ();
+
+		bake ([&] (const float * x, const float * y, const float * z, const float * nx,
+				   const float * ny, const float * nz, float * value, unsigned int count) {
+			if (noiseProjected)
+				wavelet.multibandNoise (plan, x, y, z, nx, ny, nz, value, count);
+			else
+				wavelet.multibandNoise (plan, x, y, z, value, count);
+		}, image);
+	} else if (noiseType == GaborNoise) {
+		// 2D noise ignores z, every slice of a volume is the same
+		const float scale = 1.f / (3.f * sqrt (gaborSolid ? gabor.variance3D () : gabor.variance ()));
+		bake ([&] (const float * x, const float * y, const float * z, const float *,
+				   const float *, const float *, float * value, unsigned int count) {
+			if (gaborSolid)
+				gabor.gaborNoise (x, y, z, value, count);
+			else
+				gabor.gaborNoise (x, y, value, count);
+			for (unsigned int i = 0; i < count; i++)
+				value[i] *= scale;
+		}, image);
+	} else {
+		const Perlin perlin (nbOctave, persistence, f0, perlinBasis);
+		bake ([&] (const float * x, const float * y, const float * z, const float *,
+				   const float *, const float *, float * value, unsigned int count) {
+			switch (interpolation) {
+				case Cosine:
+					perlin.perlinNoise<CosineInterpolation> (x, y, z, perlinTime, value, count);
+					break;
+				case Cubic:
+					perlin.perlinNoise<CubicInterpolation> (x, y, z, perlinTime, value, count);
+					break;
+				case Quintic:
+					perlin.perlinNoise<QuinticInterpolation> (x, y, z, perlinTime, value, count);
+					break;
+				case TableCosine:
+					perlin.perlinNoise<TableCosineInterpolation> (x, y, z, perlinTime, value, count);
+					break;
+			}
+		}, image);
+	}
+	Clock::time_point bakeDone = Clock::now ();
+
+	if (!writeImage (image)) {
+		cerr << "Could not write " << output << endl;
+		return EXIT_FAILURE;
+	}
+
+	double tileMs = chrono::duration<double, milli> (tileDone - start).count ();
+	double bakeMs = chrono::duration<double, milli> (bakeDone - tileDone).count ();
+	cout << "noisebake: " << width << "x" << height << "x" << depth << " samples, "
+		 << threadCount () << " threads, tile " << tileMs << " ms, bake " << bakeMs
+		 << " ms (" << image.size () / (bakeMs * 1e3) << " Msamples/s) -> " << output << endl;
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,1001 @@
+// Microbenchmarks for the CPU noise kernels. One line per (kernel, tile size,
+// band count) with the mean/variance over repetitions of the time per sample,
+// as CSV (default) or JSON, so runs can be diffed between releases.
+// -check measures the accuracy of the fast paths against their reference
+// instead, one line per check with the maximum error and its bound.
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <cstdio>
+#include <cmath>
+#include <chrono>
+
+#include "Vec3D.h"
+#include "Fractal.h"
+#include "Gabor.h"
+#include "Interpolation.h"
+#include "Noise.h"
+#include "Perlin.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "WaveletTile.h"
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+struct Result {
+	string kernel;
+	int tileSize;
+	int bands;
+	unsigned int items;            // samples (or tile cells) per repetition
+	vector<double> nsPerItem;      // one entry per repetition
+};
+
+static vector<Result> results;
+static unsigned int samples = 1 << 16;
+static unsigned int repetitions = 7;
+static vector<int> tileSizes;
+static vector<int> bandCounts;
+static bool json = false;
+static bool checking = false;
+
+struct Check {
+	string name;
+	unsigned int items;  // values compared
+	double maxError;
+	double bound;
+};
+
+static vector<Check> checks;
+
+static volatile float sink; // keeps the measured loops alive
+
+void printUsage () {
+	cerr << endl
+		<< "--------------------------------------" << endl
+		<< "bench_noise" << endl
+		<< "--------------------------------------" << endl
+		<< "USAGE: ./bench_noise [options]" << endl
+		<< "--------------------------------------" << endl
+		<< " -json             JSON output instead of CSV" << endl
+		<< " -check            accuracy of the fast paths instead of timings," << endl
+		<< "                   exits with failure when one is over its bound" << endl
+		<< " -samples n        samples per repetition (default 65536)" << endl
+		<< " -reps n           repetitions per measure (default 7)" << endl
+		<< " -tiles a,b,...    wavelet tile sizes (default 32,64,128)" << endl
+		<< " -bands a,b,...    band counts (default 1,3,5,8)" << endl
+		<< " -threads n        threads for the tile build (default: all cores)" << endl
+		<< "--------------------------------------" << endl;
+}
+
+vector<int> parseList (const char * list) {
+	vector<int> values;
+	for (const char * c = list; *c; ) {
+		char * end;
+		long v = strtol (c, &end, 10);
+		if (end == c || v <= 0) {
+			printUsage ();
+			exit (EXIT_FAILURE);
+		}
+		values.push_back (v);
+		c = (*end == ',') ? end+1 : end;
+	}
+	return values;
+}
+
+void parseArguments (int argc, char ** argv) {
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if (arg == "-json")
+			json = true;
+		else if (arg == "-check")
+			checking = true;
+		else if (arg == "-samples" && hasValue)
+			samples = max (1, atoi (argv[++i]));
+		else if (arg == "-reps" && hasValue)
+			repetitions = max (1, atoi (argv[++i]));
+		else if (arg == "-tiles" && hasValue)
+			tileSizes = parseList (argv[++i]);
+		else if (arg == "-bands" && hasValue)
+			bandCounts = parseList (argv[++i]);
+		else if (arg == "-threads" && hasValue)
+			setThreadCount (atoi (argv[++i]));
+		else {
+			printUsage ();
+			exit (EXIT_FAILURE);
+		}
+	}
+	if (tileSizes.empty ()) {
+		tileSizes.push_back (32); tileSizes.push_back (64); tileSizes.push_back (128);
+	}
+	if (bandCounts.empty ()) {
+		bandCounts.push_back (1); bandCounts.push_back (3);
+		bandCounts.push_back (5); bandCounts.push_back (8);
+	}
+}
+
+/* Runs f() once to warm up, then `repetitions` timed times; f processes
+   `items` items per call. */
+template <typename F>
+void measure (const string & kernel, int tileSize, int bands, unsigned int items, F f) {
+	Result r;
+	r.kernel = kernel;
+	r.tileSize = tileSize;
+	r.bands = bands;
+	r.items = items;
+	f ();
+	for (unsigned int i = 0; i < repetitions; i++) {
+		Clock::time_point start = Clock::now ();
+		f ();
+		double ns = chrono::duration<double, nano> (Clock::now () - start).count ();
+		r.nsPerItem.push_back (ns / items);
+	}
+	results.push_back (r);
+}
+
+struct Stats {
+	double mean, variance, min;
+};
+
+Stats stats (const vector<double> & v) {
+	Stats s = {0., 0., v[0]};
+	for (unsigned int i = 0; i < v.size (); i++) {
+		s.mean += v[i];
+		s.min = min (s.min, v[i]);
+	}
+	s.mean /= v.size ();
+	for (unsigned int i = 0; i < v.size (); i++)
+		s.variance += (v[i]-s.mean)*(v[i]-s.mean);
+	if (v.size () > 1)
+		s.variance /= v.size () - 1;
+	return s;
+}
+
+void printResults () {
+	if (json)
+		printf ("{\n  \"samples\": %u,\n  \"repetitions\": %u,\n  \"threads\": %u,\n  \"results\": [\n",
+				samples, repetitions, threadCount ());
+	else
+		printf ("kernel,tile,bands,items,ns_per_item,ns_variance,ns_min,items_per_sec,total_ms\n");
+	for (unsigned int i = 0; i < results.size (); i++) {
+		const Result & r = results[i];
+		Stats s = stats (r.nsPerItem);
+		double perSec = 1e9 / s.mean, totalMs = s.mean * r.items * 1e-6;
+		if (json)
+			printf ("    {\"kernel\": \"%s\", \"tile\": %d, \"bands\": %d, \"items\": %u, "
+					"\"ns_per_item\": %.4f, \"ns_variance\": %.6g, \"ns_min\": %.4f, "
+					"\"items_per_sec\": %.6g, \"total_ms\": %.4f}%s\n",
+					r.kernel.c_str (), r.tileSize, r.bands, r.items, s.mean, s.variance,
+					s.min, perSec, totalMs, i+1 < results.size () ? "," : "");
+		else
+			printf ("%s,%d,%d,%u,%.4f,%.6g,%.4f,%.6g,%.4f\n", r.kernel.c_str (), r.tileSize,
+					r.bands, r.items, s.mean, s.variance, s.min, perSec, totalMs);
+	}
+	if (json)
+		printf ("  ]\n}\n");
+}
+
+void benchRandom () {
+	measure ("uniform", 0, 0, samples, [] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += Noise::uniform ();
+		sink = acc;
+	});
+	measure ("gaussianNoise", 0, 0, samples, [] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += Noise::gaussianNoise ();
+		sink = acc;
+	});
+}
+
+/* One point at a time, like a fragment of shaderPerlin.frag; the cost of
+   the fragment itself is reported by gmini -headless, e.g. -keys v vs vx */
+template <class Interpolation>
+void benchPerlinScalar (const string & name, const Perlin & perlin, const vector<float> & x,
+						const vector<float> & y, const vector<float> & z) {
+	measure (name, 0, perlin.octave+1, samples, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += perlin.perlinNoise<Interpolation> (x[i], y[i], z[i], 0.3f);
+		sink = acc;
+	});
+}
+
+/* Per-sample cost of bakes */
+template <class Interpolation>
+void benchPerlinBatch (const string & name, const Perlin & perlin, const vector<float> & x,
+					   const vector<float> & y, const vector<float> & z) {
+	vector<float> value (samples);
+	measure (name + "_batch", 0, perlin.octave+1, samples, [&] () {
+		perlin.perlinNoise<Interpolation> (&x[0], &y[0], &z[0], 0.3f, &value[0], samples);
+		sink = value[samples-1];
+	});
+}
+
+template <class Interpolation>
+void benchPerlin (const string & name, const Perlin & perlin, const vector<float> & x,
+				  const vector<float> & y, const vector<float> & z) {
+	benchPerlinScalar<Interpolation> (name, perlin, x, y, z);
+	benchPerlinBatch<Interpolation> (name, perlin, x, y, z);
+}
+
+/* bands = octaves summed (octave+1) */
+void benchPerlin (const vector<float> & x, const vector<float> & y, const vector<float> & z) {
+	for (unsigned int b = 0; b < bandCounts.size (); b++) {
+		Perlin perlin (bandCounts[b]-1, 0.5f, 0.04f, Perlin::Value);
+		benchPerlin<CosineInterpolation> ("perlinNoise_value", perlin, x, y, z);
+		benchPerlin<CubicInterpolation> ("perlinNoise_value_cubic", perlin, x, y, z);
+		benchPerlin<QuinticInterpolation> ("perlinNoise_value_quintic", perlin, x, y, z);
+		benchPerlin<TableCosineInterpolation> ("perlinNoise_value_table", perlin, x, y, z);
+		perlin.basis = Perlin::Simplex;
+		benchPerlin<CosineInterpolation> ("perlinNoise_simplex", perlin, x, y, z);
+	}
+}
+
+/* Scalar rows call the basis once per octave per point, _batch rows run the
+   fused block evaluation */
+template <class F>
+void benchFractal (const string & name, int octaves, const F & fractal, const vector<float> & x,
+				   const vector<float> & y, const vector<float> & z) {
+	vector<float> value (samples);
+	measure (name, 0, octaves, samples, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += fractal (x[i], y[i], z[i]);
+		sink = acc;
+	});
+	measure (name + "_batch", 0, octaves, samples, [&] () {
+		fractal (&x[0], &y[0], &z[0], &value[0], samples);
+		sink = value[samples-1];
+	});
+}
+
+void benchFractal (const vector<float> & x, const vector<float> & y, const vector<float> & z) {
+	Wavelet wavelet (32);
+	WaveletBasis waveletBasis (wavelet);
+	PerlinBasis<> perlinBasis (0.3f);
+	benchFractal ("fractal_fbm_wavelet", 5, Fractal<WaveletBasis, 5> (waveletBasis, 0.25f), x, y, z);
+	benchFractal ("fractal_fbm_perlin", 5, Fractal<PerlinBasis<>, 5> (perlinBasis, 0.04f), x, y, z);
+	benchFractal ("fractal_turbulence_perlin", 5,
+				  Fractal<PerlinBasis<>, 5, Turbulence> (perlinBasis, 0.04f), x, y, z);
+	benchFractal ("fractal_ridged_perlin", 5,
+				  Fractal<PerlinBasis<>, 5, Ridged> (perlinBasis, 0.04f), x, y, z);
+	benchFractal ("fractal_warp_perlin", 5, DomainWarp<PerlinBasis<>, 5> (perlinBasis, 4.f, 0.04f),
+				  x, y, z);
+}
+
+/* Gabor rows sample a raster over [0,1000]^2, like the shader's P*1000 over
+   the unit box: the cell cache only pays off on coherent samples */
+void benchGabor () {
+	unsigned int side = sqrt ((float) samples), count = side*side;
+	vector<float> x (count), y (count), value (count);
+	for (unsigned int j = 0; j < side; j++)
+		for (unsigned int i = 0; i < side; i++) {
+			x[j*side+i] = (i+0.5f)*1000.f/side;
+			y[j*side+i] = (j+0.5f)*1000.f/side;
+		}
+
+	Gabor gabor;
+	gabor.setCellCache (false);
+	measure ("gaborNoise_nocache", 0, 0, count, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < count; i++)
+			acc += gabor.gaborNoise (x[i], y[i]);
+		sink = acc;
+	});
+	gabor.setCellCache (true);
+	measure ("gaborNoise", 0, 0, count, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < count; i++)
+			acc += gabor.gaborNoise (x[i], y[i]);
+		sink = acc;
+	});
+	measure ("gaborNoise_batch", 0, 0, count, [&] () {
+		gabor.gaborNoise (&x[0], &y[0], &value[0], count);
+		sink = value[count-1];
+	});
+	// new workers every call, like noisebake and VertexNoise::gabor
+	measure ("gaborNoise_parallel_batch", 0, 0, count, [&] () {
+		parallelFor (count, 4096, [&] (unsigned int begin, unsigned int end) {
+			gabor.gaborNoise (&x[begin], &y[begin], &value[begin], end-begin);
+		});
+		sink = value[count-1];
+	});
+
+	// 3D noise on the same raster, at z = 500
+	vector<float> z (count, 500.f);
+	measure ("gaborNoise_solid_batch", 0, 0, count, [&] () {
+		gabor.gaborNoise (&x[0], &y[0], &z[0], &value[0], count);
+		sink = value[count-1];
+	});
+
+	// fixed impulse count per cell, no branch on the impulses
+	gabor.stratified = true;
+	gabor.setCellCache (false);
+	measure ("gaborNoise_stratified_nocache", 0, 0, count, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < count; i++)
+			acc += gabor.gaborNoise (x[i], y[i]);
+		sink = acc;
+	});
+	gabor.setCellCache (true);
+	measure ("gaborNoise_stratified_batch", 0, 0, count, [&] () {
+		gabor.gaborNoise (&x[0], &y[0], &value[0], count);
+		sink = value[count-1];
+	});
+}
+
+void benchWavelet (int tileSize, const vector<float> & x, const vector<float> & y,
+				   const vector<float> & z, const vector<float> & nx,
+				   const vector<float> & ny, const vector<float> & nz) {
+	Wavelet wavelet (tileSize);
+	unsigned int cells = tileSize*tileSize*tileSize;
+	vector<float> value (samples);
+
+	measure ("generateNoiseTile", tileSize, 0, cells, [&] () {
+		wavelet.generateNoiseTile ();
+		sink = wavelet.noiseTileData[0];
+	});
+
+	measure ("wNoise", tileSize, 1, samples, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += wavelet.wNoise (Vec3Df (x[i], y[i], z[i]));
+		sink = acc;
+	});
+	measure ("wNoise_batch", tileSize, 1, samples, [&] () {
+		wavelet.wNoise (&x[0], &y[0], &z[0], &value[0], samples);
+		sink = value[samples-1];
+	});
+	measure ("wProjectedNoise", tileSize, 1, samples, [&] () {
+		float acc = 0.f;
+		for (unsigned int i = 0; i < samples; i++)
+			acc += wavelet.wProjectedNoise (Vec3Df (x[i], y[i], z[i]),
+											Vec3Df (nx[i], ny[i], nz[i]));
+		sink = acc;
+	});
+
+	for (unsigned int b = 0; b < bandCounts.size (); b++) {
+		int bands = bandCounts[b];
+		wavelet.setW (bands, Noise::octave);
+		Wavelet::BandPlan plan = wavelet.bandPlan (false);
+		Wavelet::BandPlan projectedPlan = wavelet.bandPlan (true);
+
+		measure ("multibandNoise", tileSize, bands, samples, [&] () {
+			float acc = 0.f;
+			for (unsigned int i = 0; i < samples; i++)
+				acc += wavelet.multibandNoise (Vec3Df (x[i], y[i], z[i]));
+			sink = acc;
+		});
+		measure ("multibandNoise_plan_batch", tileSize, bands, samples, [&] () {
+			wavelet.multibandNoise (plan, &x[0], &y[0], &z[0], &value[0], samples);
+			sink = value[samples-1];
+		});
+		measure ("multibandNoise_projected", tileSize, bands, samples, [&] () {
+			float acc = 0.f;
+			for (unsigned int i = 0; i < samples; i++)
+				acc += wavelet.multibandNoise (Vec3Df (x[i], y[i], z[i]),
+											   Vec3Df (nx[i], ny[i], nz[i]));
+			sink = acc;
+		});
+		measure ("multibandNoise_projected_plan_batch", tileSize, bands, samples, [&] () {
+			wavelet.multibandNoise (projectedPlan, &x[0], &y[0], &z[0],
+									&nx[0], &ny[0], &nz[0], &value[0], samples);
+			sink = value[samples-1];
+		});
+	}
+}
+
+void check (const string & name, unsigned int items, double maxError, double bound) {
+	Check c = {name, items, maxError, bound};
+	checks.push_back (c);
+}
+
+/* true if every check is within its bound */
+bool printChecks () {
+	bool passed = true;
+	if (json)
+		printf ("{\n  \"checks\": [\n");
+	else
+		printf ("check,items,max_error,bound,passed\n");
+	for (unsigned int i = 0; i < checks.size (); i++) {
+		const Check & c = checks[i];
+		bool ok = c.maxError <= c.bound;
+		passed = passed && ok;
+		if (json)
+			printf ("    {\"check\": \"%s\", \"items\": %u, \"max_error\": %.6g, "
+					"\"bound\": %.6g, \"passed\": %s}%s\n", c.name.c_str (), c.items,
+					c.maxError, c.bound, ok ? "true" : "false", i+1 < checks.size () ? "," : "");
+		else
+			printf ("%s,%u,%.6g,%.6g,%d\n", c.name.c_str (), c.items, c.maxError, c.bound, ok);
+	}
+	if (json)
+		printf ("  ]\n}\n");
+	return passed;
+}
+
+double exactCosine (float x) {
+	return (1. - cos (M_PI * x)) / 2.;
+}
+
+#if NOISE_SIMD
+NOISE_AVX2
+double tableCosineErrorAVX2 (const vector<float> & x) {
+	double error = 0.;
+	float w[8];
+	for (unsigned int i = 0; i + 8 <= x.size (); i += 8) {
+		_mm256_storeu_ps (w, TableCosineInterpolation::weight (_mm256_loadu_ps (&x[i])));
+		for (unsigned int j = 0; j < 8; j++)
+			error = max (error, fabs (w[j] - exactCosine (x[i+j])));
+	}
+	return error;
+}
+#endif
+
+/* TableCosineInterpolation against the exact curve, through the weight ()s
+   the kernels call: 64 points per table cell, its midpoints included, and
+   x = 1 where the last cell is clamped */
+void checkTableCosine () {
+	const unsigned int steps = 64*TableCosineInterpolation::Size;
+	vector<float> x (steps+8, 1.f); // x = 1 pads the AVX2 blocks
+	for (unsigned int i = 0; i < steps; i++)
+		x[i] = (float) i / steps;
+
+	double error = 0.;
+	for (unsigned int i = 0; i < x.size (); i++)
+		error = max (error, fabs (TableCosineInterpolation::weight (x[i]) - exactCosine (x[i])));
+	check ("tableCosine", x.size (), error, TableCosineInterpolation::maxError);
+#if NOISE_SIMD
+	if (hasAVX2 ())
+		check ("tableCosine_avx2", x.size (), tableCosineErrorAVX2 (x),
+			   TableCosineInterpolation::maxError);
+#endif
+}
+
+/* shaderGabor.frag's GaborNoise and the functions it calls, transcribed
+   line for line in float: what Gabor::gaborNoise (x, y) must give */
+class ShaderGabor {
+	public:
+		ShaderGabor (const Gabor & gabor)
+			: K (gabor.K), omega_0 (gabor.omega0), a (gabor.a), iso (gabor.iso), F_0 (gabor.F0),
+			  number_of_impulses_per_kernel (gabor.impulsesPerKernel) {
+			radius = sqrt (-log (0.05f) / 3.14159265f) / a;
+			impulseDensity = number_of_impulses_per_kernel / (3.14159265f * radius * radius);
+		}
+
+		float GaborNoise (float x, float y) {
+			x /= radius;
+			y /= radius;
+			int int_x = int (floor (x));
+			int int_y = int (floor (y));
+			float frac_x = x - float (int_x);
+			float frac_y = y - float (int_y);
+			float noise = 0.f;
+			for (int di = -1; di <= +1; ++di)
+				for (int dj = -1; dj <= +1; ++dj)
+					noise += cell (int_x + di, int_y + dj, frac_x - di, frac_y - dj);
+			return noise;
+		}
+
+	private:
+		float K, omega_0, a;
+		bool iso;
+		float F_0, number_of_impulses_per_kernel, radius, impulseDensity;
+		uint32_t seed_kernel;
+		static const uint32_t MAX_RAND = 0x7fffffffu;
+
+		uint32_t random () {
+			seed_kernel = seed_kernel*1103515245u+12345u;
+			return seed_kernel&MAX_RAND;
+		}
+
+		float uniform_0_1 () {
+			return float (random ()) / float (MAX_RAND);
+		}
+
+		float unif (float min, float max) {
+			return (min + (uniform_0_1 () * (max - min)));
+		}
+
+		uint32_t poisson (float mean) {
+			float g_ = exp (-mean);
+			uint32_t em = 0;
+			float t = uniform_0_1 ();
+			while (t > g_) {
+				++em;
+				t *= uniform_0_1 ();
+			}
+			return em;
+		}
+
+		float gabor (float omega, float x, float y) {
+			float gaussian_envelop = K * exp (-3.14159265f * (a * a) * ((x * x) + (y * y)));
+			float sinusoidal_carrier = cos (2.f * 3.14159265f * F_0 * ((x * cos (omega)) + (y * sin (omega))));
+			return gaussian_envelop * sinusoidal_carrier;
+		}
+
+		// the bits shifted past 32 are dropped (64 bit intermediates: a shift
+		// by 32 is undefined in C++)
+		static uint32_t morton (uint32_t x, uint32_t y) {
+			uint64_t z = 0;
+			for (uint64_t i = 0; i < 4 * 8; ++i)
+				z |= ((x & (uint64_t (1) << i)) << i) | ((y & (uint64_t (1) << i)) << (i + 1));
+			return uint32_t (z);
+		}
+
+		float cell (int i, int j, float x, float y) {
+			uint32_t seed_cell = morton (uint32_t (i), uint32_t (j));
+			if (seed_cell == 0)
+				seed_cell = 1;
+			seed_kernel = seed_cell;
+			float number_of_impulses_per_cell = impulseDensity * radius * radius;
+			uint32_t number_of_impulses = poisson (number_of_impulses_per_cell);
+			float noise = 0.f;
+			for (uint32_t i = 0; i < number_of_impulses; ++i) {
+				float x_i = uniform_0_1 ();
+				float y_i = uniform_0_1 ();
+				float w_i = unif (-1.f, +1.f);
+				float omega_0_i = iso ? unif (0.f, 2.f * 3.14159265f) : omega_0;
+				float x_i_x = x - x_i;
+				float y_i_y = y - y_i;
+				if (((x_i_x * x_i_x) + (y_i_y * y_i_y)) < 1.f)
+					noise = noise + w_i * gabor (omega_0_i, x_i_x*radius, y_i_y*radius);
+			}
+			return noise;
+		}
+};
+
+/* Gabor::gaborNoise (x, y) against ShaderGabor, bit for bit: one point at
+   a time without the cell cache, and batches on parallel workers with it,
+   twice so the second run reads the cells the first one cached */
+void checkGabor () {
+	const unsigned int count = 1 << 14;
+	vector<float> x (count), y (count), value (count);
+	for (unsigned int i = 0; i < count; i++) {
+		x[i] = 2000.f*Random::uniform (2, 2*i);
+		y[i] = 2000.f*Random::uniform (2, 2*i+1);
+	}
+
+	for (int aniso = 0; aniso <= 1; aniso++) {
+		Gabor gabor (1.f, 0.05f, 0.7f, !aniso);
+		ShaderGabor reference (gabor);
+		vector<float> expected (count);
+		for (unsigned int i = 0; i < count; i++)
+			expected[i] = reference.GaborNoise (x[i], y[i]);
+		string name = aniso ? "gaborNoise_aniso" : "gaborNoise_iso";
+
+		gabor.setCellCache (false);
+		double error = 0.;
+		for (unsigned int i = 0; i < count; i++)
+			error = max (error, (double) fabs (gabor.gaborNoise (x[i], y[i]) - expected[i]));
+		check (name + "_nocache", count, error, 0.);
+
+		gabor.setCellCache (true);
+		for (int run = 0; run < 2; run++) {
+			parallelFor (count, 1024, [&] (unsigned int begin, unsigned int end) {
+				gabor.gaborNoise (&x[begin], &y[begin], &value[begin], end-begin);
+			});
+			error = 0.;
+			for (unsigned int i = 0; i < count; i++)
+				error = max (error, (double) fabs (value[i] - expected[i]));
+			check (name + (run ? "_cached_parallel_again" : "_cached_parallel"), count, error, 0.);
+		}
+	}
+}
+
+/* Caps the kernels the dispatch picks to level; false if the CPU doesn't
+   have them */
+bool limitSimd (SimdLevel level) {
+	simdLimit () = level;
+#if NOISE_SIMD
+	return level == SimdNone || (level == SimdAVX2 ? hasAVX2 () : hasAVX512 ());
+#else
+	return level == SimdNone;
+#endif
+}
+
+/* Points for the wavelet checks, a third each within 100, 1e4 and 4e6 of
+   the origin, all signs: the batch kernels are exact for |p| < 2^22 */
+void checkPoints (unsigned int count, vector<float> & x, vector<float> & y, vector<float> & z) {
+	const float extent[3] = {100.f, 1e4f, 4e6f};
+	x.resize (count);
+	y.resize (count);
+	z.resize (count);
+	for (unsigned int i = 0; i < count; i++) {
+		x[i] = extent[i%3]*Random::uniform (3, 3*i);
+		y[i] = extent[i%3]*Random::uniform (3, 3*i+1);
+		z[i] = extent[i%3]*Random::uniform (3, 3*i+2);
+	}
+}
+
+/* The batch Wavelet::wNoise against the scalar one, bit for bit, once per
+   kernel the CPU has; the count leaves a tail for the scalar loop */
+void checkWaveletBatch () {
+	const unsigned int count = (1 << 14) + 7;
+	vector<float> x, y, z, value (count);
+	checkPoints (count, x, y, z);
+	Wavelet wavelet (32);
+
+	const SimdLevel levels[3] = {SimdNone, SimdAVX2, SimdAVX512};
+	const char * names[3] = {"wNoise_batch", "wNoise_batch_avx2", "wNoise_batch_avx512"};
+	for (int l = 0; l < 3; l++) {
+		if (!limitSimd (levels[l]))
+			continue;
+		wavelet.wNoise (&x[0], &y[0], &z[0], &value[0], count);
+		double error = 0.;
+		for (unsigned int i = 0; i < count; i++)
+			error = max (error, (double) fabs (value[i] - wavelet.wNoise (Vec3Df (x[i], y[i], z[i]))));
+		check (names[l], count, error, 0.);
+	}
+	limitSimd (SimdAVX512);
+}
+
+/* Wavelet::wProjectedNoise as it was before the per-row setup and support
+   clipping, transcribed line for line: every coefficient of the bounding
+   box, the basis argument recomputed from the dot product for each */
+class BaselineProjectedNoise {
+	public:
+		BaselineProjectedNoise (const Wavelet & wavelet)
+			: noiseTileData (wavelet.noiseTileData), noiseTileSize (wavelet.getNoiseTileSize ()) {}
+
+		float wProjectedNoise (const Vec3Df & p, const Vec3Df & normal) {
+			/* 3D noise projected onto 2D */
+			int i, c[3], min[3], max[3], n=noiseTileSize;
+
+			/* c = noise coeff location */
+			float support;
+			float result=0;
+
+			/* Bound the support of the basis functions for this projection direction */
+			for (i=0; i<3; i++) {
+				support = 3*abs(normal[i]) + 3*sqrt((1-normal[i]*normal[i])/2);
+				min[i] = ceil( p[i] - support );
+				max[i] = floor( p[i] + support );
+			}
+
+			/* Loop over the noise coefficients within the bound. */
+			for(c[2]=min[2];c[2]<=max[2];c[2]++) {
+				for(c[1]=min[1];c[1]<=max[1];c[1]++) {
+					for(c[0]=min[0];c[0]<=max[0];c[0]++) {
+						float t, t1, t2, t3, dot=0, weight=1;
+
+						/* Dot the normal with the vector from c to p */
+						for (i=0; i<3; i++) {dot+=normal[i]*(p[i]-c[i]);}
+
+						/* Evaluate the basis function at c moved halfway to p along the normal. */
+						for (i=0; i<3; i++) {
+							t = (c[i]+normal[i]*dot/2)-(p[i]-1.5); t1=t-1; t2=2-t; t3=3-t;
+							weight*=(t<=0||t>=3)? 0 : (t<1) ? t*t/2 : (t<2)? 1-(t1*t1+t2*t2)/2 : t3*t3/2;
+						}
+
+						/* Evaluate noise by weighting noise coefficients by basis function values. */
+						result += weight * noiseTileData[mod(c[2],n)*n*n+mod(c[1],n)*n+mod(c[0],n)];
+					}
+				}
+			}
+			return result;
+		}
+
+	private:
+		const float * noiseTileData;
+		int noiseTileSize;
+
+		static int mod (int x, int n) {
+			int m=x%n;
+			return (m<0) ? m+n : m;
+		}
+};
+
+/* Normals for the projected checks, unit and of any direction */
+void checkNormals (unsigned int count, vector<Vec3Df> & normal) {
+	normal.resize (count);
+	for (unsigned int i = 0; i < count; i++) {
+		normal[i] = Vec3Df (Random::uniform (4, 3*i), Random::uniform (4, 3*i+1),
+							Random::uniform (4, 3*i+2) + 1e-3f);
+		normal[i].normalize ();
+	}
+}
+
+/* Wavelet::wProjectedNoise against BaselineProjectedNoise, with the scalar
+   and the AVX2 row kernels, within 100 of the origin. Farther the float
+   coordinates round both: at 4e6 each is 0.1 off its own value one tile
+   period away. */
+void checkProjectedBaseline () {
+	const unsigned int count = 1 << 14;
+	vector<Vec3Df> normal;
+	checkNormals (count, normal);
+	Wavelet wavelet (32);
+	BaselineProjectedNoise baseline (wavelet);
+	vector<float> expected (count);
+	vector<Vec3Df> p (count);
+	for (unsigned int i = 0; i < count; i++) {
+		p[i] = Vec3Df (100.f*Random::uniform (5, 3*i), 100.f*Random::uniform (5, 3*i+1),
+					   100.f*Random::uniform (5, 3*i+2));
+		expected[i] = baseline.wProjectedNoise (p[i], normal[i]);
+	}
+
+	const SimdLevel levels[2] = {SimdNone, SimdAVX2};
+	const char * names[2] = {"wProjectedNoise_baseline", "wProjectedNoise_baseline_avx2"};
+	for (int l = 0; l < 2; l++) {
+		if (!limitSimd (levels[l]))
+			continue;
+		double error = 0.;
+		for (unsigned int i = 0; i < count; i++)
+			error = max (error, (double) fabs (wavelet.wProjectedNoise (p[i], normal[i]) - expected[i]));
+		check (names[l], count, error, 1e-5);
+	}
+	limitSimd (SimdAVX512);
+}
+
+/* WaveletTile<32, Pad> against the Wavelet it copies, bit for bit: wNoise,
+   and wProjectedNoise against the scalar row kernel it follows */
+template <int Pad>
+void checkWaveletTile (const Wavelet & wavelet, const vector<float> & x, const vector<float> & y,
+					   const vector<float> & z, const vector<Vec3Df> & normal,
+					   const vector<float> & expected, const vector<float> & expectedProjected) {
+	WaveletTile<32, Pad> tile (wavelet);
+	double error = 0., projectedError = 0.;
+	for (unsigned int i = 0; i < x.size (); i++) {
+		Vec3Df p (x[i], y[i], z[i]);
+		error = max (error, (double) fabs (tile.wNoise (p) - expected[i]));
+		projectedError = max (projectedError,
+							  (double) fabs (tile.wProjectedNoise (p, normal[i]) - expectedProjected[i]));
+	}
+	string name = "WaveletTile_32_" + to_string (Pad);
+	check (name + "_wNoise", x.size (), error, 0.);
+	check (name + "_wProjectedNoise", x.size (), projectedError, 0.);
+}
+
+void checkWaveletTiles () {
+	const unsigned int count = 1 << 14;
+	vector<float> x, y, z, expected (count), expectedProjected (count);
+	vector<Vec3Df> normal;
+	checkPoints (count, x, y, z);
+	checkNormals (count, normal);
+	Wavelet wavelet (32);
+	limitSimd (SimdNone);
+	for (unsigned int i = 0; i < count; i++) {
+		expected[i] = wavelet.wNoise (Vec3Df (x[i], y[i], z[i]));
+		expectedProjected[i] = wavelet.wProjectedNoise (Vec3Df (x[i], y[i], z[i]), normal[i]);
+	}
+	limitSimd (SimdAVX512);
+
+	checkWaveletTile<0> (wavelet, x, y, z, normal, expected, expectedProjected);
+	checkWaveletTile<1> (wavelet, x, y, z, normal, expected, expectedProjected);
+	checkWaveletTile<4> (wavelet, x, y, z, normal, expected, expectedProjected);
+}
+
+/* A gradient evaluator against its value-only counterpart: the value bit
+   for bit, and each gradient component against the central difference of
+   step Wavelet::gradientStep, over the positions the step rounds to */
+template <class Value, class Gradient>
+void checkGradient (const string & name, const vector<Vec3Df> & p, const vector<Vec3Df> & normal,
+					Value value, Gradient gradient) {
+	const float h = Wavelet::gradientStep;
+	double valueError = 0., gradientError = 0.;
+	for (unsigned int i = 0; i < p.size (); i++) {
+		Vec3Df g;
+		valueError = max (valueError, (double) fabs (gradient (p[i], normal[i], g)
+													 - value (p[i], normal[i])));
+		for (int k = 0; k < 3; k++) {
+			Vec3Df after = p[i], before = p[i];
+			after[k] += h;
+			before[k] -= h;
+			double central = (value (after, normal[i]) - value (before, normal[i]))
+				/ (double) (after[k] - before[k]);
+			gradientError = max (gradientError, fabs (g[k] - central));
+		}
+	}
+	check (name + "_value", p.size (), valueError, 0.);
+	check (name + "_gradient", p.size (), gradientError, Wavelet::gradientError);
+}
+
+/* wNoiseGradient, wProjectedNoiseGradient and multibandNoiseGradient, within
+   100 of the origin; the projected values are those of the scalar row
+   kernel, which the gradients follow */
+void checkGradients () {
+	const unsigned int count = 1 << 12;
+	vector<Vec3Df> p (count), normal;
+	checkNormals (count, normal);
+	for (unsigned int i = 0; i < count; i++)
+		p[i] = Vec3Df (100.f*Random::uniform (6, 3*i), 100.f*Random::uniform (6, 3*i+1),
+					   100.f*Random::uniform (6, 3*i+2));
+	Wavelet wavelet (32);
+	const Wavelet::BandPlan plan = wavelet.bandPlan (false), projectedPlan = wavelet.bandPlan (true);
+	limitSimd (SimdNone);
+
+	checkGradient ("wNoiseGradient", p, normal,
+				   [&] (const Vec3Df & q, const Vec3Df &) { return wavelet.wNoise (q); },
+				   [&] (const Vec3Df & q, const Vec3Df &, Vec3Df & g) {
+					   return wavelet.wNoiseGradient (q, g); });
+	checkGradient ("wProjectedNoiseGradient", p, normal,
+				   [&] (const Vec3Df & q, const Vec3Df & n) { return wavelet.wProjectedNoise (q, n); },
+				   [&] (const Vec3Df & q, const Vec3Df & n, Vec3Df & g) {
+					   return wavelet.wProjectedNoiseGradient (q, n, g); });
+	checkGradient ("multibandNoiseGradient", p, normal,
+				   [&] (const Vec3Df & q, const Vec3Df &) { return wavelet.multibandNoise (plan, q); },
+				   [&] (const Vec3Df & q, const Vec3Df &, Vec3Df & g) {
+					   return wavelet.multibandNoiseGradient (plan, q, g); });
+	checkGradient ("multibandNoiseGradient_projected", p, normal,
+				   [&] (const Vec3Df & q, const Vec3Df & n) {
+					   return wavelet.multibandNoise (projectedPlan, q, n); },
+				   [&] (const Vec3Df & q, const Vec3Df & n, Vec3Df & g) {
+					   return wavelet.multibandNoiseGradient (projectedPlan, q, n, g); });
+	limitSimd (SimdAVX512);
+}
+
+/* shaderPerlin.frag's PerlinNoise_4D with the value basis (basis 0), and
+   the functions it calls, transcribed line for line in float: what
+   Perlin::perlinNoise must give. The int arithmetic of Hash4 wraps like
+   GLSL's, in unsigned to stay defined in C++. */
+class ShaderPerlin {
+	public:
+		ShaderPerlin (const Perlin & perlin)
+			: octave (perlin.octave), persistence (perlin.persistence), f0 (perlin.f0) {}
+
+		float PerlinNoise_4D (float x, float y, float z, float t) {
+			float p = persistence;
+			float n = octave;
+
+			float frequency = f0;
+			float amplitude = 1.f;
+
+			float total = 0;
+			for (int i=0; i<=n; i++) {
+				total += InterpolatedNoise4D (x * frequency, y * frequency, z*frequency, t*frequency) * amplitude;
+
+				frequency *= 2.f;
+				amplitude *= p;
+			}
+
+			return total * (1.f -p) / (1.f - amplitude);
+		}
+
+	private:
+		int octave;
+		float persistence, f0;
+
+		float Interpolate (float a, float b, float x) {
+			float ft = x * 3.1415927f;
+			float f = (1.f - cos (ft)) * 0.5f;
+
+			return a * (1.f-f) + b*f;
+		}
+
+		int Hash4 (int x, int y, int z, int t) {
+			uint32_t c = 57;
+			uint32_t n = x*c;
+			c *= 57;
+			n += c*y;
+			c *= 57;
+			n += c*z;
+			c *= 57;
+			n += c*t;
+
+			n = (n<<13) ^ n;
+			return (n * (n * n * 15731u + 789221u) + 1376312589u) & 0x7fffffffu;
+		}
+
+		float Noise4 (int x, int y, int z, int t) {
+			return 1.f - Hash4 (x, y, z, t) / 1073741824.f;
+		}
+
+		float InterpolatedNoise2D (float x, float y, int z, int t) {
+			int integer_X    = int (floor (x));
+			float fractional_X = x - integer_X;
+
+			int integer_Y    = int (floor (y));
+			float fractional_Y = y - integer_Y;
+
+			float v1 = Noise4 (integer_X,     integer_Y, z, t);
+			float v2 = Noise4 (integer_X + 1, integer_Y, z, t);
+			float v3 = Noise4 (integer_X,     integer_Y + 1, z, t);
+			float v4 = Noise4 (integer_X + 1, integer_Y + 1, z, t);
+
+			float i1 = Interpolate (v1 , v2 , fractional_X);
+			float i2 = Interpolate (v3 , v4 , fractional_X);
+
+			return Interpolate (i1 , i2 , fractional_Y);
+		}
+
+		float InterpolatedNoise3D (float x, float y, float z, int t) {
+			int integer_Z    = int (floor (z));
+			float fractional_Z = z - integer_Z;
+
+			float v1 = InterpolatedNoise2D (x, y, integer_Z, t);
+			float v2 = InterpolatedNoise2D (x, y, integer_Z+1, t);
+
+			return Interpolate (v1, v2, fractional_Z);
+		}
+
+		float InterpolatedNoise4D (float x, float y, float z, float t) {
+			int integer_T    = int (floor (t));
+			float fractional_T = t - integer_T;
+
+			float v1 = InterpolatedNoise3D (x, y, z, integer_T);
+			float v2 = InterpolatedNoise3D (x, y, z, integer_T+1);
+
+			return Interpolate (v1, v2, fractional_T);
+		}
+};
+
+/* Perlin::perlinNoise with the value basis against ShaderPerlin: the
+   scalar path and the batch without SIMD bit for bit, the AVX2 batch
+   within the 1e-6 its cosine polynomial is documented to keep */
+void checkPerlin () {
+	const unsigned int count = 1 << 14;
+	vector<float> x, y, z, value (count), expected (count);
+	checkPoints (count, x, y, z);
+	const float t = 3.7f;
+	Perlin perlin (4, 0.5f, 1.f, Perlin::Value);
+	ShaderPerlin reference (perlin);
+	for (unsigned int i = 0; i < count; i++)
+		expected[i] = reference.PerlinNoise_4D (x[i], y[i], z[i], t);
+
+	double error = 0.;
+	for (unsigned int i = 0; i < count; i++)
+		error = max (error, (double) fabs (perlin.perlinNoise (x[i], y[i], z[i], t) - expected[i]));
+	check ("perlinNoise_value", count, error, 0.);
+
+	const SimdLevel levels[2] = {SimdNone, SimdAVX2};
+	const char * names[2] = {"perlinNoise_value_batch", "perlinNoise_value_batch_avx2"};
+	const double bounds[2] = {0., 1e-6};
+	for (int l = 0; l < 2; l++) {
+		if (!limitSimd (levels[l]))
+			continue;
+		perlin.perlinNoise (&x[0], &y[0], &z[0], t, &value[0], count);
+		error = 0.;
+		for (unsigned int i = 0; i < count; i++)
+			error = max (error, (double) fabs (value[i] - expected[i]));
+		check (names[l], count, error, bounds[l]);
+	}
+	limitSimd (SimdAVX512);
+}
+
+int runChecks () {
+	checkTableCosine ();
+	checkGabor ();
+	checkWaveletBatch ();
+	checkProjectedBaseline ();
+	checkWaveletTiles ();
+	checkGradients ();
+	checkPerlin ();
+	return printChecks () ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+int main (int argc, char ** argv) {
+	parseArguments (argc, argv);
+	if (checking)
+		return runChecks ();
+	Wavelet::setTileCache (""); // time the generation, never the cache
+
+	// Fixed inputs: positions spread over a few tiles, unit normals
+	vector<float> x (samples), y (samples), z (samples), nx (samples), ny (samples), nz (samples);
+	for (unsigned int i = 0; i < samples; i++) {
+		x[i] = 100.f*Random::uniform01 (1, 6*i);
+		y[i] = 100.f*Random::uniform01 (1, 6*i+1);
+		z[i] = 100.f*Random::uniform01 (1, 6*i+2);
+		Vec3Df n (Random::uniform (1, 6*i+3), Random::uniform (1, 6*i+4),
+				  Random::uniform (1, 6*i+5) + 0.1f);
+		n.normalize ();
+		nx[i] = n[0];
+		ny[i] = n[1];
+		nz[i] = n[2];
+	}
+
+	benchRandom ();
+	benchPerlin (x, y, z);
+	benchFractal (x, y, z);
+	benchGabor ();
+	for (unsigned int t = 0; t < tileSizes.size (); t++)
+		benchWavelet (tileSizes[t], x, y, z, nx, ny, nz);
+
+	printResults ();
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,271 @@
+#pragma once
+
+#include <cmath>
+
+#include "Gabor.h"
+#include "Noise.h"
+#include "Perlin.h"
+
+/*
+Fractal sums over any basis noise. A basis is a small adapter with
+
+  float operator()(float x, float y, float z) const;
+  void operator()(const float *x, const float *y, const float *z,
+                  float *result, unsigned int count) const;
+
+(WaveletBasis, PerlinBasis and GaborBasis below). Fractal<Basis, Octaves, Composition>
+sums Octaves octaves of it, at frequency f0*lacunarity^i with amplitude
+gain^i (or any of the Noise weight functions), and Composition decides what
+each octave adds:
+
+  FBm         n                         (result in about [-1,1])
+  Turbulence  |n|                       (result in [0,1])
+  Ridged      (1-|n|)^2, weighted by the previous octave (Musgrave's
+              ridged multifractal, offset 1 and gain 2; result in [0,1])
+
+The sum is divided by the sum of the amplitudes. DomainWarp composes one
+fractal with the same fractal displaced by three others.
+
+Octaves is a compile-time constant so the octave loop unrolls. The batch
+operator() runs the whole composition over blocks of points: one basis
+batch call per octave per block, instead of one call per octave per point.
+*/
+
+struct FBm {
+  static float octave(float n, float amplitude, float &) {
+    return n * amplitude;
+  }
+};
+
+struct Turbulence {
+  static float octave(float n, float amplitude, float &) {
+    return fabs(n) * amplitude;
+  }
+};
+
+struct Ridged {
+  /* weight starts at 1 and carries the previous octave's signal */
+  static float octave(float n, float amplitude, float &weight) {
+    float signal = 1.f - fabs(n);
+    signal *= signal * weight;
+    weight = signal * 2.f;
+    weight = (weight > 1.f) ? 1.f : weight;
+    return signal * amplitude;
+  }
+};
+
+template <class Basis, int Octaves, class Composition = FBm>
+class Fractal {
+  static_assert(Octaves >= 1, "a fractal needs at least one octave");
+
+  public:
+    enum { Block = 256 };
+
+    Fractal(const Basis &basis, float f0=1.f, float lacunarity=2.f, float gain=0.5f)
+      : basis(basis) {
+      float f = f0, a = 1.f;
+      for (int i=0; i<Octaves; i++) {
+        frequency[i] = f;
+        amplitude[i] = a;
+        f *= lacunarity;
+        a *= gain;
+      }
+      normalize();
+    }
+
+    /* Amplitudes from one of the Noise weight functions (Noise::octave,
+       Noise::constant, Noise::invLinear, Noise::linear) */
+    void setWeights(float (*f) (unsigned int)) {
+      for (int i=0; i<Octaves; i++)
+        amplitude[i] = f(i);
+      normalize();
+    }
+
+    float operator()(float x, float y, float z) const {
+      float total = 0.f, weight = 1.f;
+      for (int i=0; i<Octaves; i++) {
+        float f = frequency[i];
+        total += Composition::octave(basis(x*f, y*f, z*f), amplitude[i], weight);
+      }
+      return total * normalization;
+    }
+
+    float operator()(const Vec3Df &p) const {
+      return (*this)(p[0], p[1], p[2]);
+    }
+
+    void operator()(const float *x, const float *y, const float *z,
+                    float *result, unsigned int count) const {
+      float fx[Block], fy[Block], fz[Block], n[Block], weight[Block];
+
+      for (unsigned int begin=0; begin<count; begin+=Block) {
+        unsigned int size = (count-begin < (unsigned int)Block) ? count-begin : Block;
+        float *total = result + begin;
+        for (unsigned int j=0; j<size; j++) {
+          total[j] = 0.f;
+          weight[j] = 1.f;
+        }
+        for (int i=0; i<Octaves; i++) {
+          float f = frequency[i];
+          for (unsigned int j=0; j<size; j++) {
+            fx[j] = x[begin+j]*f;
+            fy[j] = y[begin+j]*f;
+            fz[j] = z[begin+j]*f;
+          }
+          basis(fx, fy, fz, n, size);
+          for (unsigned int j=0; j<size; j++)
+            total[j] += Composition::octave(n[j], amplitude[i], weight[j]);
+        }
+        for (unsigned int j=0; j<size; j++)
+          total[j] *= normalization;
+      }
+    }
+
+  private:
+    void normalize() {
+      float sum = 0.f;
+      for (int i=0; i<Octaves; i++)
+        sum += amplitude[i];
+      normalization = (sum != 0.f) ? 1.f/sum : 1.f;
+    }
+
+    Basis basis;
+    float frequency[Octaves];
+    float amplitude[Octaves];
+    float normalization;
+};
+
+/*
+fractal(p + strength*(warp(p), warp(p+o1), warp(p+o2))): the warp is an fBm
+of the same basis and octave count, sampled at three decorrelated offsets.
+*/
+template <class Basis, int Octaves, class Composition = FBm>
+class DomainWarp {
+  public:
+    enum { Block = 256 };
+
+    DomainWarp(const Basis &basis, float strength=1.f, float f0=1.f,
+               float lacunarity=2.f, float gain=0.5f)
+      : fractal(basis, f0, lacunarity, gain), warp(basis, f0, lacunarity, gain),
+        strength(strength) {
+    }
+
+    Fractal<Basis, Octaves, Composition> &getFractal() { return fractal; }
+    Fractal<Basis, Octaves, FBm> &getWarp() { return warp; }
+
+    float operator()(float x, float y, float z) const {
+      float dx = warp(x, y, z);
+      float dy = warp(x+offset[0][0], y+offset[0][1], z+offset[0][2]);
+      float dz = warp(x+offset[1][0], y+offset[1][1], z+offset[1][2]);
+      return fractal(x + strength*dx, y + strength*dy, z + strength*dz);
+    }
+
+    float operator()(const Vec3Df &p) const {
+      return (*this)(p[0], p[1], p[2]);
+    }
+
+    void operator()(const float *x, const float *y, const float *z,
+                    float *result, unsigned int count) const {
+      float wx[Block], wy[Block], wz[Block], d[3][Block];
+
+      for (unsigned int begin=0; begin<count; begin+=Block) {
+        unsigned int size = (count-begin < (unsigned int)Block) ? count-begin : Block;
+        const float *px = x+begin, *py = y+begin, *pz = z+begin;
+        warp(px, py, pz, d[0], size);
+        for (int k=0; k<2; k++) {
+          for (unsigned int j=0; j<size; j++) {
+            wx[j] = px[j] + offset[k][0];
+            wy[j] = py[j] + offset[k][1];
+            wz[j] = pz[j] + offset[k][2];
+          }
+          warp(wx, wy, wz, d[k+1], size);
+        }
+        for (unsigned int j=0; j<size; j++) {
+          wx[j] = px[j] + strength*d[0][j];
+          wy[j] = py[j] + strength*d[1][j];
+          wz[j] = pz[j] + strength*d[2][j];
+        }
+        fractal(wx, wy, wz, result+begin, size);
+      }
+    }
+
+  private:
+    static constexpr float offset[2][3] = {{5.2f, 1.3f, 2.8f}, {1.7f, 9.2f, 4.1f}};
+
+    Fractal<Basis, Octaves, Composition> fractal;
+    Fractal<Basis, Octaves, FBm> warp;
+    float strength;
+};
+
+template <class Basis, int Octaves, class Composition>
+constexpr float DomainWarp<Basis, Octaves, Composition>::offset[2][3];
+
+/******************************************************************************/
+
+/* One band of wavelet noise: Wavelet::wNoise, batched through its
+   AVX2/AVX-512 kernel */
+class WaveletBasis {
+  public:
+    explicit WaveletBasis(Wavelet &wavelet) : wavelet(&wavelet) {}
+
+    float operator()(float x, float y, float z) const {
+      return wavelet->wNoise(Vec3Df(x, y, z));
+    }
+
+    void operator()(const float *x, const float *y, const float *z,
+                    float *result, unsigned int count) const {
+      wavelet->wNoise(x, y, z, result, count);
+    }
+
+  private:
+    Wavelet *wavelet;
+};
+
+/* One octave of the shader's 4D noise at a fixed t (not scaled by the
+   octave frequency), value or simplex basis */
+template <class Interpolation = CosineInterpolation>
+class PerlinBasis {
+  public:
+    explicit PerlinBasis(float t=0.f, Perlin::Basis basis=Perlin::Value)
+      : t(t), octave(0, 0.5f, 1.f, basis) {
+    }
+
+    float operator()(float x, float y, float z) const {
+      return (octave.basis == Perlin::Simplex) ? Perlin::simplexNoise(x, y, z, t)
+        : Perlin::interpolatedNoise<Interpolation>(x, y, z, t);
+    }
+
+    /* a single octave at f0 = 1: the Perlin normalization is exact */
+    void operator()(const float *x, const float *y, const float *z,
+                    float *result, unsigned int count) const {
+      octave.perlinNoise<Interpolation>(x, y, z, t, result, count);
+    }
+
+  private:
+    float t;
+    Perlin octave;
+};
+
+/* 2D Gabor noise in the (x, y) plane, divided by 3 standard deviations like
+   shaderGabor.frag; z is ignored */
+class GaborBasis {
+  public:
+    explicit GaborBasis(const Gabor &gabor)
+      : gabor(&gabor), scale(1.f / (3.f * std::sqrt(gabor.variance()))) {
+    }
+
+    float operator()(float x, float y, float) const {
+      return gabor->gaborNoise(x, y) * scale;
+    }
+
+    void operator()(const float *x, const float *y, const float *,
+                    float *result, unsigned int count) const {
+      gabor->gaborNoise(x, y, result, count);
+      for (unsigned int i=0; i<count; i++)
+        result[i] *= scale;
+    }
+
+  private:
+    const Gabor *gabor;
+    float scale;
+};
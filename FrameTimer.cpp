@@ -0,0 +1,144 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+
+#include "FrameTimer.h"
+using namespace std;
+
+/* frames in flight before a frame goes without GPU time */
+static const unsigned int queryCount = 4;
+
+FrameTimer::FrameTimer(unsigned int window)
+  : window(window), nextQuery(0), runningQuery(-1) {
+  if (GLEW_ARB_timer_query) {
+	queries.resize(2*queryCount);
+	glGenQueriesARB(2*queryCount, &queries[0]);
+	queryFrame.assign(queryCount, -1);
+  }
+}
+
+FrameTimer::~FrameTimer() {
+  if (!queries.empty())
+	glDeleteQueriesARB(queries.size(), &queries[0]);
+}
+
+void FrameTimer::collect(bool wait) {
+  for (unsigned int i=0; i<queryFrame.size(); i++) {
+	if (queryFrame[i] == -1 || (int) i == runningQuery)
+	  continue;
+	GLint startAvailable = GL_TRUE, endAvailable = GL_TRUE;
+	if (!wait) {
+	  glGetQueryObjectivARB(queries[2*i], GL_QUERY_RESULT_AVAILABLE_ARB, &startAvailable);
+	  glGetQueryObjectivARB(queries[2*i+1], GL_QUERY_RESULT_AVAILABLE_ARB, &endAvailable);
+	}
+	if (!startAvailable || !endAvailable)
+	  continue;
+	GLuint64 start, end;
+	glGetQueryObjectui64v(queries[2*i], GL_QUERY_RESULT_ARB, &start);
+	glGetQueryObjectui64v(queries[2*i+1], GL_QUERY_RESULT_ARB, &end);
+	samples[queryFrame[i]].ms[Gpu] = (end - start) * 1e-6f;
+	queryFrame[i] = -1;
+  }
+}
+
+void FrameTimer::beginFrame() {
+  endGpu();
+  Clock::time_point now = Clock::now();
+  if (!samples.empty())
+	samples.back().ms[Frame] = chrono::duration<float, milli>(now - frameStart).count();
+  frameStart = now;
+  addSpan(now);
+
+  Sample sample;
+  fill(sample.ms, sample.ms + SeriesCount, -1.f);
+  sample.ms[Upload] = sample.ms[Submit] = 0.f;
+  samples.push_back(sample);
+
+  if (queryFrame.empty())
+	return;
+  collect(false);
+  if (queryFrame[nextQuery] != -1)
+	return;
+  runningQuery = nextQuery;
+  nextQuery = (nextQuery + 1) % queryFrame.size();
+  queryFrame[runningQuery] = samples.size() - 1;
+  glQueryCounter(queries[2*runningQuery], GL_TIMESTAMP);
+}
+
+void FrameTimer::endGpu() {
+  if (runningQuery == -1)
+	return;
+  glQueryCounter(queries[2*runningQuery+1], GL_TIMESTAMP);
+  runningQuery = -1;
+}
+
+void FrameTimer::addSpan(Clock::time_point now) {
+  if (!open.empty() && !samples.empty())
+	samples.back().ms[open.back()] += chrono::duration<float, milli>(now - spanStart).count();
+  spanStart = now;
+}
+
+void FrameTimer::begin(Series span) {
+  addSpan(Clock::now());
+  open.push_back(span);
+}
+
+void FrameTimer::end(Series span) {
+  addSpan(Clock::now());
+  if (!open.empty() && open.back() == span)
+	open.pop_back();
+}
+
+float FrameTimer::percentile(Series series, float p) const {
+  vector<float> values;
+  for (size_t i = samples.size() > window ? samples.size() - window : 0; i < samples.size(); i++)
+	if (samples[i].ms[series] >= 0.f)
+	  values.push_back(samples[i].ms[series]);
+  if (values.empty())
+	return -1.f;
+  /* nearest rank: the ceil(p/100 n)-th smallest, p times n first so that
+     whole ranks stay whole */
+  float position = ceil(p * values.size() / 100.f);
+  size_t rank = position < 1.f ? 0 : min(values.size(), (size_t) position) - 1;
+  nth_element(values.begin(), values.begin() + rank, values.end());
+  return values[rank];
+}
+
+string FrameTimer::report() const {
+  static const char *names[SeriesCount] = {"upload", "submit", "gpu", "frame"};
+  string line;
+  for (unsigned int s=0; s<SeriesCount; s++) {
+	char text[96];
+	if (percentile((Series) s, 50.f) < 0.f)
+	  snprintf(text, sizeof(text), "%s -", names[s]);
+	else
+	  snprintf(text, sizeof(text), "%s %.3f/%.3f/%.3f", names[s], percentile((Series) s, 50.f),
+			   percentile((Series) s, 95.f), percentile((Series) s, 99.f));
+	line += (s ? ", " : "") + string(text);
+  }
+  return line + " ms (p50/p95/p99)";
+}
+
+void FrameTimer::finish() {
+  endGpu();
+  if (!queryFrame.empty())
+	collect(true);
+}
+
+bool FrameTimer::writeCSV(const string &filename) const {
+  ofstream out(filename.c_str());
+  if (!out)
+	return false;
+  out << "frame,upload_ms,submit_ms,gpu_ms,frame_ms\n";
+  for (size_t i=0; i<samples.size(); i++) {
+	out << i;
+	for (unsigned int s=0; s<SeriesCount; s++) {
+	  out << ",";
+	  if (samples[i].ms[s] >= 0.f)
+		out << samples[i].ms[s];
+	}
+	out << "\n";
+  }
+  return bool(out);
+}
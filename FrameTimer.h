@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+/*
+Per-frame timings:
+  Upload: CPU time sending the shader parameters and the per-vertex noise
+  Submit: CPU time issuing the draw, without the uploads within it
+  Gpu:    GPU time of the frame, between two GL_TIMESTAMP queries
+  Frame:  time between the starts of two frames
+The CPU spans are begun and ended around the code they measure. A span begun
+inside another pauses it, so each counts its own time only.
+
+The query pairs are a ring, their results read when available at the next
+frames: reading one before the GPU is done would wait for it. When the ring
+is full the frame goes without a GPU time rather than waiting. Timestamps
+rather than a GL_TIME_ELAPSED query, which llvmpipe answers with garbage on
+the first frame. Without GL_ARB_timer_query there is no GPU time at all.
+
+Every frame is kept for the CSV; the percentiles are over the last window
+frames.
+*/
+class FrameTimer {
+  public:
+    typedef enum {Upload, Submit, Gpu, Frame, SeriesCount} Series;
+
+    FrameTimer(unsigned int window=256);
+    ~FrameTimer();
+
+    /* A new frame, and its GPU query; the spans until the next call count for it */
+    void beginFrame();
+    /* The end of the GPU work of the frame */
+    void endGpu();
+
+    /* Upload or Submit */
+    void begin(Series span);
+    void end(Series span);
+
+    /* The p-th percentile in milliseconds of the last window frames, -1
+       without any */
+    float percentile(Series series, float p) const;
+
+    /* p50/p95/p99 of each series, one line */
+    std::string report() const;
+
+    /* Waits for the queries still running: for the trace, before exiting */
+    void finish();
+
+    /* frame,upload_ms,submit_ms,gpu_ms,frame_ms; no GPU time left empty */
+    bool writeCSV(const std::string &filename) const;
+
+  private:
+    FrameTimer(const FrameTimer &);
+    FrameTimer &operator= (const FrameTimer &);
+
+    typedef std::chrono::steady_clock Clock;
+    struct Sample {
+      float ms[SeriesCount];   // -1 when not measured
+    };
+
+    void collect(bool wait);
+    void addSpan(Clock::time_point now);
+
+    std::vector<Sample> samples;
+    unsigned int window;
+    Clock::time_point frameStart;
+
+    std::vector<Series> open;     // the spans begun, innermost last
+    Clock::time_point spanStart;  // of the innermost one, or since its inner one ended
+
+    std::vector<GLuint> queries;  // start and end of each pair
+    std::vector<int> queryFrame;  // the frame of each pair, -1 if free
+    unsigned int nextQuery;
+    int runningQuery;             // between beginFrame and endGpu, or -1
+};
@@ -0,0 +1,457 @@
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "Gabor.h"
+using namespace std;
+
+/* The constants of shaderGabor.frag */
+static const float PI = 3.14159265f;
+static const uint32_t MAX_RAND = 0x7fffffffu;
+
+float Gabor::radius() const {
+  return sqrt(-log(0.05f) / PI) / a;
+}
+
+float Gabor::impulseDensity() const {
+  float r = radius();
+  return impulsesPerKernel / (PI * r * r);
+}
+
+float Gabor::variance() const {
+  float integralGaborFilterSquared = ((K * K) / (4.f * a * a))
+	* (1.f + exp(-(2.f * PI * F0 * F0) / (a * a)));
+  return impulseDensity() * (1.f / 3.f) * integralGaborFilterSquared;
+}
+
+unsigned int Gabor::strata() const {
+  float r = radius();
+  return max(1, int(sqrt(impulseDensity() * r * r)));
+}
+
+float Gabor::impulseDensity3D() const {
+  float r = radius();
+  return impulsesPerKernel / ((4.f / 3.f) * PI * r * r * r);
+}
+
+float Gabor::variance3D() const {
+  /* the Gaussian integrates to (2 a^2)^(-3/2) in 3D instead of 1/(2 a^2) */
+  float integralGaborFilterSquared = ((K * K) / (2.f * pow(2.f * a * a, 1.5f)))
+	* (1.f + exp(-(2.f * PI * F0 * F0) / (a * a)));
+  return impulseDensity3D() * (1.f / 3.f) * integralGaborFilterSquared;
+}
+
+unsigned int Gabor::impulseBudget() const {
+  /* the Poisson count goes over 4 standard deviations above its mean about
+	 once in 10^4 cells */
+  float r = radius(), mean = impulseDensity3D() * r * r * r;
+  return ceil(mean + 4.f * sqrt(mean));
+}
+
+uint32_t Gabor::morton(uint32_t x, uint32_t y) {
+  /* spreads the low 16 bits to the even bits; the shader's loop shifts the
+	 higher ones out of the 32 bits */
+  uint32_t v[2] = {x & 0xffffu, y & 0xffffu};
+  for (int i=0; i<2; i++) {
+	v[i] = (v[i] | (v[i] << 8)) & 0x00ff00ffu;
+	v[i] = (v[i] | (v[i] << 4)) & 0x0f0f0f0fu;
+	v[i] = (v[i] | (v[i] << 2)) & 0x33333333u;
+	v[i] = (v[i] | (v[i] << 1)) & 0x55555555u;
+  }
+  return v[0] | (v[1] << 1);
+}
+
+uint32_t Gabor::morton(uint32_t x, uint32_t y, uint32_t z) {
+  uint32_t v[3] = {x & 0x3ffu, y & 0x3ffu, z & 0x3ffu};
+  for (int i=0; i<3; i++) {
+	v[i] = (v[i] | (v[i] << 16)) & 0x030000ffu;
+	v[i] = (v[i] | (v[i] << 8)) & 0x0300f00fu;
+	v[i] = (v[i] | (v[i] << 4)) & 0x030c30c3u;
+	v[i] = (v[i] | (v[i] << 2)) & 0x09249249u;
+  }
+  return v[0] | (v[1] << 1) | (v[2] << 2);
+}
+
+void Gabor::generateCell(uint32_t seed, float mean, bool iso, float omega0,
+						 vector<Impulse> &impulses) {
+  uint32_t state = seed;
+  auto uniform01 = [&state] () {
+	state = state*1103515245u + 12345u;
+	return float(state & MAX_RAND) / float(MAX_RAND);
+  };
+
+  /* poisson() */
+  float g = exp(-mean), t = uniform01();
+  unsigned int count = 0;
+  while (t > g) {
+	count++;
+	t *= uniform01();
+  }
+
+  float cosOmega0 = cos(omega0), sinOmega0 = sin(omega0);
+  impulses.resize(count);
+  for (unsigned int i=0; i<count; i++) {
+	Impulse &impulse = impulses[i];
+	impulse.x = uniform01();
+	impulse.y = uniform01();
+	impulse.weight = -1.f + uniform01() * 2.f;
+	if (iso) {
+	  impulse.omega = uniform01() * (2.f * PI);
+	  impulse.cosOmega = cos(impulse.omega);
+	  impulse.sinOmega = sin(impulse.omega);
+	} else {
+	  impulse.omega = omega0;
+	  impulse.cosOmega = cosOmega0;
+	  impulse.sinOmega = sinOmega0;
+	}
+  }
+}
+
+void Gabor::generateStratifiedCell(uint32_t seed, unsigned int strata, bool iso,
+								   float omega0, vector<Impulse> &impulses) {
+  uint32_t state = seed;
+  auto uniform01 = [&state] () {
+	state = state*1103515245u + 12345u;
+	return float(state & MAX_RAND) / float(MAX_RAND);
+  };
+
+  float cosOmega0 = cos(omega0), sinOmega0 = sin(omega0), step = 1.f / strata;
+  impulses.resize(strata * strata);
+  for (unsigned int i=0; i<impulses.size(); i++) {
+	Impulse &impulse = impulses[i];
+	impulse.x = (i % strata + uniform01()) * step;
+	impulse.y = (i / strata + uniform01()) * step;
+	impulse.weight = -1.f + uniform01() * 2.f;
+	if (iso) {
+	  impulse.omega = uniform01() * (2.f * PI);
+	  impulse.cosOmega = cos(impulse.omega);
+	  impulse.sinOmega = sin(impulse.omega);
+	} else {
+	  impulse.omega = omega0;
+	  impulse.cosOmega = cosOmega0;
+	  impulse.sinOmega = sinOmega0;
+	}
+  }
+}
+
+void Gabor::generateCell(uint32_t seed, float mean, unsigned int budget, bool iso,
+						 float omega0, vector<Impulse3D> &impulses) {
+  uint32_t state = seed;
+  auto uniform01 = [&state] () {
+	state = state*1103515245u + 12345u;
+	return float(state & MAX_RAND) / float(MAX_RAND);
+  };
+
+  float g = exp(-mean), t = uniform01();
+  unsigned int count = 0;
+  while (t > g && count < budget) {
+	count++;
+	t *= uniform01();
+  }
+
+  impulses.resize(count);
+  for (unsigned int i=0; i<count; i++) {
+	Impulse3D &impulse = impulses[i];
+	impulse.x = uniform01();
+	impulse.y = uniform01();
+	impulse.z = uniform01();
+	impulse.weight = -1.f + uniform01() * 2.f;
+	float omega = omega0, cosTheta = 0.f;
+	if (iso) {
+	  omega = uniform01() * (2.f * PI);
+	  cosTheta = -1.f + uniform01() * 2.f;
+	}
+	float sinTheta = sqrt(1.f - cosTheta*cosTheta);
+	impulse.dx = sinTheta * cos(omega);
+	impulse.dy = sinTheta * sin(omega);
+	impulse.dz = cosTheta;
+  }
+}
+
+void Gabor::impulseAtlas(unsigned int period, vector<float> &texels,
+						 unsigned int &slots) const {
+  float r = radius(), mean = impulseDensity() * r * r;
+  vector<vector<Impulse> > cells(period*period);
+  slots = 0;
+  for (unsigned int j=0; j<period; j++)
+	for (unsigned int i=0; i<period; i++) {
+	  uint32_t seed = morton(i, j);
+	  generateCell(seed ? seed : 1, mean, iso, omega0, cells[j*period+i]);
+	  slots = max(slots, (unsigned int)cells[j*period+i].size());
+	}
+  slots++; // the count
+
+  texels.assign(4*period*slots*period, 0.f);
+  for (unsigned int c=0; c<cells.size(); c++) {
+	float *texel = &texels[4*(c/period*period*slots + c%period*slots)];
+	texel[0] = cells[c].size();
+	texel += 4;
+	for (unsigned int k=0; k<cells[c].size(); k++, texel+=4) {
+	  texel[0] = cells[c][k].x;
+	  texel[1] = cells[c][k].y;
+	  texel[2] = cells[c][k].weight;
+	  texel[3] = cells[c][k].omega;
+	}
+  }
+}
+
+namespace {
+/* Direct-mapped table of cells, by a hash of their seed. What a cell holds
+   only depends on the seed and on the few parameters kept here; the table
+   empties itself when they change. */
+template <class Impulse>
+struct CellTable {
+  enum { Bits = 10, Size = 1 << Bits };
+
+  uint32_t seed[Size]; // 0 = empty, cell seeds are never 0
+  vector<Impulse> impulses[Size];
+  float mean, omega0;
+  bool iso;
+  unsigned int count; // 2D: the strata, 0 for Poisson cells; 3D: the budget
+
+  CellTable() : mean(-1.f), omega0(0.f), iso(false), count(0) {
+	fill(seed, seed+Size, 0u);
+  }
+
+  void configure(float m, bool i, float o, unsigned int c) {
+	if (i)
+	  o = 0.f; // isotropic impulses draw their own orientation
+	if (m == mean && i == iso && o == omega0 && c == count)
+	  return;
+	mean = m;
+	iso = i;
+	omega0 = o;
+	count = c;
+	fill(seed, seed+Size, 0u);
+  }
+
+  void generate(uint32_t s, vector<Gabor::Impulse> &cell) const {
+	if (count)
+	  Gabor::generateStratifiedCell(s, count, iso, omega0, cell);
+	else
+	  Gabor::generateCell(s, mean, iso, omega0, cell);
+  }
+
+  void generate(uint32_t s, vector<Gabor::Impulse3D> &cell) const {
+	Gabor::generateCell(s, mean, count, iso, omega0, cell);
+  }
+
+  const vector<Impulse> &cell(uint32_t s) {
+	unsigned int slot = (s * 2654435761u) >> (32 - Bits);
+	if (seed[slot] != s) {
+	  generate(s, impulses[slot]);
+	  seed[slot] = s;
+	}
+	return impulses[slot];
+  }
+};
+
+/* The tables outlive the evaluations and the threads: each batch borrows
+   one for its duration and gives it back. parallelFor starts and joins its
+   workers on every call, so tables owned by threads would start empty each
+   time; from the pool the next batch, on any thread, finds the cells of an
+   earlier one. There are as many tables as batches ever ran at once. */
+template <class Impulse>
+class CellTablePool {
+  public:
+	~CellTablePool() {
+	  for (unsigned int i=0; i<tables.size(); i++)
+		delete tables[i];
+	}
+
+	CellTable<Impulse> *acquire() {
+	  lock_guard<mutex> lock(guard);
+	  if (tables.empty())
+		return new CellTable<Impulse>;
+	  CellTable<Impulse> *table = tables.back();
+	  tables.pop_back();
+	  return table;
+	}
+
+	void release(CellTable<Impulse> *table) {
+	  lock_guard<mutex> lock(guard);
+	  tables.push_back(table);
+	}
+
+  private:
+	mutex guard;
+	vector<CellTable<Impulse> *> tables; // the ones not lent
+};
+
+CellTablePool<Gabor::Impulse> cellTables;
+CellTablePool<Gabor::Impulse3D> cellTables3D;
+thread_local vector<Gabor::Impulse> cellScratch;
+thread_local vector<Gabor::Impulse3D> cellScratch3D;
+}
+
+struct Gabor::Kernel {
+  float radius, K, gaussian, carrier; // gaussian = -pi a^2, carrier = 2 pi F0
+  float mean, omega0;
+  bool iso;
+  unsigned int strata; // 0 for Poisson cells
+  unsigned int budget; // solid cells
+  CellTable<Impulse> *cells;      // NULL without the cache, from the pools
+  CellTable<Impulse3D> *cells3D;
+
+  Kernel() : cells(NULL), cells3D(NULL) {}
+  ~Kernel() {
+	if (cells)
+	  cellTables.release(cells);
+	if (cells3D)
+	  cellTables3D.release(cells3D);
+  }
+};
+
+void Gabor::setupKernel(Kernel &kernel, bool solid) const {
+  kernel.radius = radius();
+  kernel.K = K;
+  kernel.gaussian = -PI * (a * a);
+  kernel.carrier = 2.f * PI * F0;
+  kernel.mean = impulseDensity() * kernel.radius * kernel.radius;
+  kernel.omega0 = omega0;
+  kernel.iso = iso;
+  kernel.strata = 0;
+  kernel.budget = 0;
+  if (solid) {
+	kernel.mean = impulseDensity3D() * kernel.radius * kernel.radius * kernel.radius;
+	kernel.budget = impulseBudget();
+	if (cellCache) {
+	  kernel.cells3D = cellTables3D.acquire();
+	  kernel.cells3D->configure(kernel.mean, iso, omega0, kernel.budget);
+	}
+	return;
+  }
+  if (stratified) {
+	/* the variance only depends on the impulse density and the mean squared
+	   weight, not on where the impulses are */
+	kernel.strata = strata();
+	kernel.K *= sqrt(kernel.mean / (kernel.strata * kernel.strata));
+  }
+  if (cellCache) {
+	kernel.cells = cellTables.acquire();
+	kernel.cells->configure(kernel.mean, iso, omega0, kernel.strata);
+  }
+}
+
+float Gabor::noise(const Kernel &kernel, float x, float y) const {
+  x /= kernel.radius;
+  y /= kernel.radius;
+  int ix = floor(x), iy = floor(y);
+  float fx = x - ix, fy = y - iy;
+  float noise = 0.f;
+
+  for (int di=-1; di<=1; di++)
+	for (int dj=-1; dj<=1; dj++) {
+	  uint32_t seed = morton(ix+di, iy+dj);
+	  if (!seed)
+		seed = 1;
+	  const vector<Impulse> *impulses = &cellScratch;
+	  if (kernel.cells)
+		impulses = &kernel.cells->cell(seed);
+	  else if (kernel.strata)
+		generateStratifiedCell(seed, kernel.strata, kernel.iso, kernel.omega0, cellScratch);
+	  else
+		generateCell(seed, kernel.mean, kernel.iso, kernel.omega0, cellScratch);
+
+	  float cx = fx - di, cy = fy - dj, cellNoise = 0.f;
+	  if (kernel.strata) {
+		/* every impulse, out of reach ones weigh 0 */
+		for (unsigned int i=0; i<impulses->size(); i++) {
+		  const Impulse &impulse = (*impulses)[i];
+		  float dx = cx - impulse.x, dy = cy - impulse.y;
+		  float gx = dx*kernel.radius, gy = dy*kernel.radius;
+		  float envelope = kernel.K * exp(kernel.gaussian * (gx*gx + gy*gy));
+		  float harmonic = cos(kernel.carrier * (gx*impulse.cosOmega + gy*impulse.sinOmega));
+		  float weight = (dx*dx + dy*dy < 1.f) ? impulse.weight : 0.f;
+		  cellNoise += weight * (envelope * harmonic);
+		}
+		noise += cellNoise;
+		continue;
+	  }
+
+	  /* cell() */
+	  for (unsigned int i=0; i<impulses->size(); i++) {
+		const Impulse &impulse = (*impulses)[i];
+		float dx = cx - impulse.x, dy = cy - impulse.y;
+		if (dx*dx + dy*dy < 1.f) {
+		  float gx = dx*kernel.radius, gy = dy*kernel.radius;
+		  float envelope = kernel.K * exp(kernel.gaussian * (gx*gx + gy*gy));
+		  float harmonic = cos(kernel.carrier * (gx*impulse.cosOmega + gy*impulse.sinOmega));
+		  cellNoise += impulse.weight * (envelope * harmonic);
+		}
+	  }
+	  noise += cellNoise;
+	}
+  return noise;
+}
+
+float Gabor::gaborNoise(float x, float y) const {
+  Kernel kernel;
+  setupKernel(kernel);
+  return noise(kernel, x, y);
+}
+
+void Gabor::gaborNoise(const float *x, const float *y, float *result, unsigned int count) const {
+  Kernel kernel;
+  setupKernel(kernel);
+  for (unsigned int i=0; i<count; i++)
+	result[i] = noise(kernel, x[i], y[i]);
+}
+
+float Gabor::noise(const Kernel &kernel, float x, float y, float z) const {
+  x /= kernel.radius;
+  y /= kernel.radius;
+  z /= kernel.radius;
+  int ix = floor(x), iy = floor(y), iz = floor(z);
+  float fx = x - ix, fy = y - iy, fz = z - iz;
+
+  /* squared distance from the sample to the neighbour cells along each
+	 axis, for d = -1, 0, 1 */
+  float reachX[3] = {fx*fx, 0.f, (1.f-fx)*(1.f-fx)};
+  float reachY[3] = {fy*fy, 0.f, (1.f-fy)*(1.f-fy)};
+  float reachZ[3] = {fz*fz, 0.f, (1.f-fz)*(1.f-fz)};
+  float noise = 0.f;
+
+  for (int di=-1; di<=1; di++)
+	for (int dj=-1; dj<=1; dj++)
+	  for (int dk=-1; dk<=1; dk++) {
+		if (reachX[di+1] + reachY[dj+1] + reachZ[dk+1] >= 1.f)
+		  continue;
+		uint32_t seed = morton(ix+di, iy+dj, iz+dk);
+		if (!seed)
+		  seed = 1;
+		const vector<Impulse3D> *impulses = &cellScratch3D;
+		if (kernel.cells3D)
+		  impulses = &kernel.cells3D->cell(seed);
+		else
+		  generateCell(seed, kernel.mean, kernel.budget, kernel.iso, kernel.omega0, cellScratch3D);
+
+		float cx = fx - di, cy = fy - dj, cz = fz - dk, cellNoise = 0.f;
+		for (unsigned int i=0; i<impulses->size(); i++) {
+		  const Impulse3D &impulse = (*impulses)[i];
+		  float dx = cx - impulse.x, dy = cy - impulse.y, dz = cz - impulse.z;
+		  if (dx*dx + dy*dy + dz*dz < 1.f) {
+			float gx = dx*kernel.radius, gy = dy*kernel.radius, gz = dz*kernel.radius;
+			float envelope = kernel.K * exp(kernel.gaussian * (gx*gx + gy*gy + gz*gz));
+			float harmonic = cos(kernel.carrier * (gx*impulse.dx + gy*impulse.dy + gz*impulse.dz));
+			cellNoise += impulse.weight * (envelope * harmonic);
+		  }
+		}
+		noise += cellNoise;
+	  }
+  return noise;
+}
+
+float Gabor::gaborNoise(float x, float y, float z) const {
+  Kernel kernel;
+  setupKernel(kernel, true);
+  return noise(kernel, x, y, z);
+}
+
+void Gabor::gaborNoise(const float *x, const float *y, const float *z, float *result,
+					   unsigned int count) const {
+  Kernel kernel;
+  setupKernel(kernel, true);
+  for (unsigned int i=0; i<count; i++)
+	result[i] = noise(kernel, x[i], y[i], z[i]);
+}
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+#include "Noise.h"
+
+/*
+Sparse convolution Gabor noise, the CPU version of shaderGabor.frag: the same
+LCG, Morton cell seeds, Poisson impulse counts and kernels, so
+gaborNoise(x, y) is the shader's GaborNoise(x, y) (bench_noise -check
+compares them with a literal port of it).
+
+The shader regenerates the impulses of 9 cells for every sample. Here the
+impulses of a cell are generated once and kept in a bounded table indexed by
+the cell seed: neighbouring samples visit mostly the same cells and only
+evaluate the kernels. Each call borrows a table from a shared pool for its
+duration, so any number of threads can evaluate at once and the cells stay
+cached from one call, or thread, to the next.
+*/
+class Gabor: public Noise {
+  public:
+    float K;                 // magnitude of the kernels
+    float a;                 // bandwidth, the Gaussian falls as exp(-pi a^2 r^2)
+    float omega0;            // orientation when anisotropic
+    bool iso;                // a random orientation per impulse
+    float F0;                // frequency of the harmonic
+    float impulsesPerKernel; // mean number of impulses under a kernel
+    bool stratified;         // a fixed jittered grid of impulses per cell
+
+    Gabor(float K=1.f, float a=0.05f, float omega0=0.f, bool iso=true,
+          float F0=0.0625f, float impulsesPerKernel=64.f)
+      : K(K), a(a), omega0(omega0), iso(iso), F0(F0), impulsesPerKernel(impulsesPerKernel),
+        stratified(false), cellCache(true) {
+    }
+
+    /* The kernels are truncated where the Gaussian falls to 5%; the cells
+       are radius wide */
+    float radius() const;
+    float impulseDensity() const;
+    float variance() const;
+
+    /* Stratified cells hold strata()^2 impulses, one jittered in each square
+       of a strata() x strata() grid, for about the Poisson mean. The weights
+       are scaled so the variance stays variance(), and every impulse of the
+       9 cells is evaluated, out of reach ones masked to 0: the cost of a
+       sample is fixed and the loops have no data-dependent branch. */
+    unsigned int strata() const;
+
+    /* Solid noise, the same kernels in 3D: a random direction on the sphere
+       when iso, (cos omega0, sin omega0, 0) otherwise. The cells are radius
+       wide cubes holding on average impulsesPerKernel impulses per kernel
+       ball, at most impulseBudget(). Of the 27 cells around a sample only
+       those within radius of it are visited, and the impulses out of reach
+       are rejected before their kernel is evaluated. */
+    float impulseDensity3D() const;
+    float variance3D() const;
+    unsigned int impulseBudget() const;
+    float gaborNoise(float x, float y, float z) const;
+    void gaborNoise(const float *x, const float *y, const float *z, float *result,
+                    unsigned int count) const;
+
+    /* GaborNoise */
+    float gaborNoise(float x, float y) const;
+
+    /* gaborNoise at (x[i], y[i]) for i < count */
+    void gaborNoise(const float *x, const float *y, float *result, unsigned int count) const;
+
+    /* Off, every cell visit regenerates its impulses, like the shader */
+    void setCellCache(bool enabled) { cellCache = enabled; }
+
+    struct Impulse {
+      float x, y;               // in the cell, [0,1]
+      float weight;             // [-1,1]
+      float omega;              // orientation of the harmonic
+      float cosOmega, sinOmega;
+    };
+
+    struct Impulse3D {
+      float x, y, z;            // in the cell, [0,1]
+      float weight;             // [-1,1]
+      float dx, dy, dz;         // direction of the harmonic
+    };
+
+    /* The shader's morton(): the low 16 bits of x and y interleaved */
+    static uint32_t morton(uint32_t x, uint32_t y);
+
+    /* The low 10 bits of x, y and z interleaved */
+    static uint32_t morton(uint32_t x, uint32_t y, uint32_t z);
+
+    /* The impulses of the cell with this seed, drawn like shaderGabor.frag */
+    static void generateCell(uint32_t seed, float mean, bool iso, float omega0,
+                             std::vector<Impulse> &impulses);
+
+    /* The impulses of a stratified cell, same random sequence per impulse */
+    static void generateStratifiedCell(uint32_t seed, unsigned int strata, bool iso,
+                                       float omega0, std::vector<Impulse> &impulses);
+
+    /* The impulses of a solid cell, no more than budget */
+    static void generateCell(uint32_t seed, float mean, unsigned int budget, bool iso,
+                             float omega0, std::vector<Impulse3D> &impulses);
+
+    /* The impulses of the cells [0,period)^2 as an RGBA float texture for
+       the shader, period*slots texels wide and period high: cell (i, j)
+       starts at texel i*slots of row j with its impulse count n in red,
+       then n texels of (x, y, weight, omega). slots is one more than the
+       largest count. Cells outside the block repeat it. */
+    void impulseAtlas(unsigned int period, std::vector<float> &texels,
+                      unsigned int &slots) const;
+
+  private:
+    struct Kernel;
+    void setupKernel(Kernel &kernel, bool solid=false) const;
+    float noise(const Kernel &kernel, float x, float y) const;
+    float noise(const Kernel &kernel, float x, float y, float z) const;
+
+    bool cellCache;
+};
@@ -0,0 +1,106 @@
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include "HeadlessContext.h"
+using namespace std;
+
+HeadlessContext::HeadlessContext()
+  : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT),
+	width(0), height(0) {
+}
+
+HeadlessContext::~HeadlessContext() {
+  if (display == EGL_NO_DISPLAY)
+	return;
+  eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+  if (context != EGL_NO_CONTEXT)
+	eglDestroyContext(display, context);
+  if (surface != EGL_NO_SURFACE)
+	eglDestroySurface(display, surface);
+  eglTerminate(display);
+}
+
+bool HeadlessContext::fail(const string &what) {
+  ostringstream out;
+  out << what << " failed, EGL error 0x" << hex << eglGetError();
+  message = out.str();
+  return false;
+}
+
+bool HeadlessContext::create(unsigned int w, unsigned int h) {
+  width = w;
+  height = h;
+
+#ifdef EGL_PLATFORM_SURFACELESS_MESA
+  const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+  PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+	(PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless") && getPlatformDisplay)
+	display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+#endif
+  if (display == EGL_NO_DISPLAY)
+	display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+  if (display == EGL_NO_DISPLAY)
+	return fail("eglGetDisplay");
+  if (!eglInitialize(display, NULL, NULL)) {
+	display = EGL_NO_DISPLAY;
+	return fail("eglInitialize");
+  }
+
+  const EGLint configAttributes[] = {
+	EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+	EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+	EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+	EGL_DEPTH_SIZE, 24,
+	EGL_NONE
+  };
+  EGLConfig config;
+  EGLint configs = 0;
+  if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) || configs == 0)
+	return fail("eglChooseConfig");
+
+  const EGLint surfaceAttributes[] = {EGL_WIDTH, (EGLint) w, EGL_HEIGHT, (EGLint) h, EGL_NONE};
+  surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+  if (surface == EGL_NO_SURFACE)
+	return fail("eglCreatePbufferSurface");
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+	return fail("eglBindAPI");
+  context = eglCreateContext(display, config, EGL_NO_CONTEXT, NULL);
+  if (context == EGL_NO_CONTEXT)
+	return fail("eglCreateContext");
+  if (!eglMakeCurrent(display, surface, surface, context))
+	return fail("eglMakeCurrent");
+  return true;
+}
+
+void HeadlessContext::readPixels(vector<unsigned char> &rgb) const {
+  rgb.resize((size_t) 3*width*height);
+  glFinish();
+  glPixelStorei(GL_PACK_ALIGNMENT, 1);
+  glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &rgb[0]);
+
+  /* GL rows go bottom to top */
+  vector<unsigned char> row(3*width);
+  for (unsigned int j = 0; j < height/2; j++) {
+	unsigned char *top = &rgb[(size_t) 3*width*j], *bottom = &rgb[(size_t) 3*width*(height-1-j)];
+	memcpy(&row[0], top, row.size());
+	memcpy(top, bottom, row.size());
+	memcpy(bottom, &row[0], row.size());
+  }
+}
+
+bool HeadlessContext::writePPM(const string &filename, const vector<unsigned char> &rgb) const {
+  ofstream out(filename.c_str(), ios::binary);
+  if (!out)
+	return false;
+  out << "P6\n" << width << " " << height << "\n255\n";
+  out.write((const char *) &rgb[0], rgb.size());
+  return bool(out);
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/*
+An OpenGL context without a window, for gmini -headless: an EGL pbuffer of
+the frame size. The display is Mesa's surfaceless platform when EGL offers
+it, so no X server is needed and Mesa renders on a GPU render node or, with
+none or LIBGL_ALWAYS_SOFTWARE=1, on llvmpipe; otherwise the default display.
+The context is the legacy one gmini uses with GLUT, fixed-function state
+included.
+*/
+class HeadlessContext {
+  public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    /* The context made current, with a width x height RGB color and 24 bit
+       depth buffer; false with error() set otherwise */
+    bool create(unsigned int width, unsigned int height);
+    const std::string &error() const { return message; }
+
+    /* The color buffer after glFinish, top row first, 3 bytes per pixel */
+    void readPixels(std::vector<unsigned char> &rgb) const;
+
+    /* rgb as read by readPixels, as a binary PPM */
+    bool writePPM(const std::string &filename, const std::vector<unsigned char> &rgb) const;
+
+  private:
+    HeadlessContext(const HeadlessContext &);
+    HeadlessContext &operator= (const HeadlessContext &);
+
+    bool fail(const std::string &what);
+
+    /* EGLDisplay, EGLSurface and EGLContext: egl.h stays out of Main.cpp,
+       it brings the X11 headers and their macros */
+    void *display, *surface, *context;
+    unsigned int width, height;
+    std::string message;
+};
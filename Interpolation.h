@@ -0,0 +1,113 @@
+#pragma once
+
+#include <cmath>
+
+#include "Simd.h"
+
+/*
+Interpolation policies for the lattice noises. weight(x) turns the position
+x in [0,1] between two lattice values into the blend factor, and
+interpolate<Policy>(a, b, x) blends like Noise::cosineInterpolation.
+Everything is inline, so a lattice template instantiated with a policy
+compiles to straight-line code. Each policy also has an AVX2 weight for the
+batch kernels, which blend a*(1-f)+b*f the same way.
+*/
+
+/* (1-cos(pi x))/2, the shaders' Interpolate(), in float with their
+   3.1415927: x * M_PI in double rounds differently */
+struct CosineInterpolation {
+  static float weight(float x) {
+    float ft = x * 3.1415927f;
+    return (1.f - std::cos(ft)) * 0.5f;
+  }
+
+#if NOISE_SIMD
+  /* (1+sin(pi (x-1/2)))/2 with sin as its degree 11 Taylor polynomial on
+     [-pi/2, pi/2]: truncation error below 6e-8, within 1e-7 of weight()
+     once rounding is counted. */
+  NOISE_AVX2 static __m256 weight(__m256 x) {
+    const __m256 half = _mm256_set1_ps(0.5f);
+    __m256 u = _mm256_mul_ps(_mm256_sub_ps(x, half), _mm256_set1_ps(M_PI));
+    __m256 u2 = _mm256_mul_ps(u, u);
+    __m256 p = _mm256_set1_ps(-1.f/39916800.f);
+    p = _mm256_add_ps(_mm256_mul_ps(p, u2), _mm256_set1_ps(1.f/362880.f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, u2), _mm256_set1_ps(-1.f/5040.f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, u2), _mm256_set1_ps(1.f/120.f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, u2), _mm256_set1_ps(-1.f/6.f));
+    p = _mm256_add_ps(_mm256_mul_ps(p, u2), _mm256_set1_ps(1.f));
+    return _mm256_add_ps(half, _mm256_mul_ps(half, _mm256_mul_ps(p, u)));
+  }
+#endif
+};
+
+/* Cubic Hermite smoothstep 3x^2-2x^3: C1 at the lattice points */
+struct CubicInterpolation {
+  static float weight(float x) {
+    return x*x*(3.f-2.f*x);
+  }
+
+#if NOISE_SIMD
+  NOISE_AVX2 static __m256 weight(__m256 x) {
+    return _mm256_mul_ps(_mm256_mul_ps(x, x),
+                         _mm256_sub_ps(_mm256_set1_ps(3.f), _mm256_add_ps(x, x)));
+  }
+#endif
+};
+
+/* Quintic 6x^5-15x^4+10x^3: C2 at the lattice points */
+struct QuinticInterpolation {
+  static float weight(float x) {
+    return x*x*x*(x*(x*6.f-15.f)+10.f);
+  }
+
+#if NOISE_SIMD
+  NOISE_AVX2 static __m256 weight(__m256 x) {
+    __m256 p = _mm256_sub_ps(_mm256_mul_ps(x, _mm256_set1_ps(6.f)), _mm256_set1_ps(15.f));
+    p = _mm256_add_ps(_mm256_mul_ps(x, p), _mm256_set1_ps(10.f));
+    return _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(x, x), x), p);
+  }
+#endif
+};
+
+/*
+The cosine curve read from a table of Size+1 samples and linearly
+interpolated. Linear interpolation with step h = 1/Size is off by at most
+h^2/8 * max|f''| = pi^2/(16 Size^2) = 9.41e-6 for Size = 256; maxError adds
+room for float rounding. bench_noise -check measures the error of both
+weight()s against the exact curve and holds them to maxError.
+*/
+struct TableCosineInterpolation {
+  enum { Size = 256 };
+  static const float maxError;
+
+  struct Table {
+    float value[Size+1];
+    Table();
+  };
+  static const Table table;
+
+  static float weight(float x) {
+    float s = x * Size;
+    int i = s;
+    if (i > Size-1) i = Size-1;
+    float f = s - i;
+    return table.value[i] + (table.value[i+1]-table.value[i]) * f;
+  }
+
+#if NOISE_SIMD
+  NOISE_AVX2 static __m256 weight(__m256 x) {
+    __m256 s = _mm256_mul_ps(x, _mm256_set1_ps(Size));
+    __m256i i = _mm256_min_epi32(_mm256_cvttps_epi32(s), _mm256_set1_epi32(Size-1));
+    __m256 f = _mm256_sub_ps(s, _mm256_cvtepi32_ps(i));
+    __m256 v0 = _mm256_i32gather_ps(table.value, i, 4);
+    __m256 v1 = _mm256_i32gather_ps(table.value + 1, i, 4);
+    return _mm256_add_ps(v0, _mm256_mul_ps(_mm256_sub_ps(v1, v0), f));
+  }
+#endif
+};
+
+template <class Policy>
+inline float interpolate(float a, float b, float x) {
+  float f = Policy::weight(x);
+  return a*(1-f) + b*f;
+}
@@ -26,6 +26,7 @@
 #include <string>
 #include <cstring>
 #include <cstdlib>
+#include <chrono>
 
 #define GLEW_STATIC 1
 #include <GL/glew.h>
@@ -38,7 +39,13 @@
 #include "Mesh.h"
 #include "Camera.h"
 #include "Noise.h"
+#include "Gabor.h"
 #include "NoiseShaders.h"
+#include "PerlinSliceCache.h"
+#include "VertexNoise.h"
+#include "MeshBuffers.h"
+#include "HeadlessContext.h"
+#include "FrameTimer.h"
 
 using namespace std;
 
@@ -56,9 +63,24 @@ static PhongShader * shader;
 static PerlinShader * perlinShader;
 static GaborShader * gaborShader;
 static WaveletShader * waveletShader;
+static VertexNoiseShader * vertexNoiseShader;
 
 static Mesh mesh;
 static GLuint glID;
+static MeshBuffers * meshBuffers;    // the model in vertex/index buffers
+static bool useDisplayList = false;  // or the display list and immediate mode
+
+static string startupKeys;  // -keys: keyboard commands applied at startup
+
+static FrameTimer * frameTimer;
+static string traceFile = "frametimes.csv"; // -trace: the timings written on exit, none if empty
+
+// -headless: frames rendered offscreen and written to disk, no window
+static bool headless = false;
+static unsigned int headlessFrames = 60;
+static float headlessTurn = 360.0f;          // degrees around the y axis over the frames
+static string headlessOutput = "frame";      // <output>0000.ppm..., none if empty
+static const float headlessTimeStep = 0.0017f; // perlinTime per frame, idle () at 60 FPS
 
 
 typedef enum {Solid, Phong} RenderingMode;
@@ -119,12 +141,17 @@ static int nbOctave = 4;
 static float persistence = 0.5;
 static int f0 = 1.0;
 static float perlinTime = 0;
+static bool perlinSimplex = false;
+static PerlinSliceCache * perlinCache; // per-vertex value noise
 
 // gabor properties
 static float K = 1.0f;
 static float omega = 0.0;
 static float a = 0.05;
 static bool iso = true;
+static bool impulseAtlas = false; // impulses read from a CPU-built texture
+static bool stratified = false;   // a fixed jittered grid of impulses per cell
+static bool solid = false;        // 3D noise instead of the (x, y) plane
 
 // Phong properties
 static float diffuseRef = 0.8f;
@@ -137,11 +164,27 @@ static int firstBand = -1;
 static int tileSize = 2;
 static bool noiseProjected = false;
 static float s = 0.0;
+static Wavelet vertexWavelet (4); // per-vertex wavelet, with the shader's tile
+
+// noise sampling: per fragment, per vertex, or per vertex once the
+// triangles get smaller than the pixels
+typedef enum {PerPixel, PerVertex, Auto} NoiseSampling;
+static NoiseSampling sampling = Auto;
+static bool perVertex = false; // sampling of the current frame
+static VertexNoise vertexNoise;
+// Auto: per vertex below 1 pixel per triangle, back to per pixel above 2
+static const float perVertexBelow = 1.0f;
+static const float perPixelAbove = 2.0f;
 
 void setShaderValues () {
 
+	if (perVertex)
+		vertexNoiseShader->setNoiseType (shader == perlinShader ? VertexNoiseShader::PerlinNoise
+				: shader == waveletShader ? VertexNoiseShader::WaveletNoise
+				: VertexNoiseShader::GaborNoise);
+
 	// wavelet
-	if (shader == waveletShader) {
+	if (!perVertex && shader == waveletShader) {
 		waveletShader->setTileSize (tileSize);
 		waveletShader->setnBandsRef (nbands);
 		waveletShader->setfirstBand (firstBand);
@@ -150,28 +193,129 @@ void setShaderValues () {
 	}
 
 	// perlin
-	if (shader == perlinShader) {
+	if (!perVertex && shader == perlinShader) {
 		perlinShader->setnbOctave (nbOctave);
 		perlinShader->setPersistence (persistence);
 		perlinShader->setF0 (f0); 
 		perlinShader->setTime(perlinTime);
+		perlinShader->setBasis (perlinSimplex ? 1 : 0);
 	}
 
 	// gabor
-	if (shader == gaborShader) {
+	if (!perVertex && shader == gaborShader) {
 		gaborShader->setKRef (K);
 		gaborShader->setOmegaRef (omega);
 		gaborShader->setARef (a);
 		gaborShader->setIsoRef (iso);
+		gaborShader->setImpulseAtlas (impulseAtlas, iso);
+		gaborShader->setStratified (stratified);
+		gaborShader->setSolid (solid);
 	}
 
 	// brdf
-	shader->setDiffuseRef (diffuseRef);
-	shader->setSpecRef (specRef);
-	shader->setShininess (shininess);
+	PhongShader * bound = perVertex ? vertexNoiseShader : shader;
+	bound->setDiffuseRef (diffuseRef);
+	bound->setSpecRef (specRef);
+	bound->setShininess (shininess);
+	bound->setWireframe (mode == Solid && !useDisplayList);
 }
 
-void drawMesh (bool flat) {
+// The selected noise at every mesh vertex, as its fragment shader computes it
+const vector<float> & vertexNoiseValues () {
+	if (shader == perlinShader && !perlinSimplex) {
+		perlinCache->setPerlin (nbOctave, persistence, f0);
+		return perlinCache->evaluate (perlinTime);
+	}
+	if (shader == perlinShader)
+		return vertexNoise.perlin (Perlin (nbOctave, persistence, f0, Perlin::Simplex), perlinTime);
+
+	// wavelet and gabor noise don't move: their values are kept until a
+	// parameter changes
+	static PhongShader * keptShader = NULL;
+	static vector<float> kept, keptParameters;
+	vector<float> parameters;
+	if (shader == gaborShader)
+		parameters = {K, a, omega, (float) iso, (float) stratified, (float) solid};
+	else
+		parameters = {(float) nbands, (float) firstBand, (float) noiseProjected, s};
+	if (shader == keptShader && parameters == keptParameters)
+		return kept;
+
+	if (shader == gaborShader) {
+		Gabor gabor (K, a, omega, iso);
+		gabor.stratified = stratified;
+		kept = vertexNoise.gabor (gabor, solid);
+	}
+	else {
+		vertexWavelet.s = s;
+		vertexWavelet.firstBand = firstBand;
+		vertexWavelet.setW (nbands, Noise::linear);
+		kept = vertexNoise.wavelet (vertexWavelet, vertexWavelet.bandPlan (noiseProjected));
+	}
+	keptShader = shader;
+	keptParameters = parameters;
+	return kept;
+}
+
+// Mean screen area in pixels of the front-facing triangles, over every
+// stride-th triangle, with the current GL matrices
+float meanTrianglePixels (unsigned int stride) {
+	GLdouble modelview[16], projection[16], m[16];
+	GLint viewport[4];
+	glGetDoublev (GL_MODELVIEW_MATRIX, modelview);
+	glGetDoublev (GL_PROJECTION_MATRIX, projection);
+	glGetIntegerv (GL_VIEWPORT, viewport);
+	for (unsigned int c = 0; c < 4; c++)
+		for (unsigned int r = 0; r < 4; r++) {
+			m[c*4+r] = 0;
+			for (unsigned int k = 0; k < 4; k++)
+				m[c*4+r] += projection[k*4+r] * modelview[c*4+k];
+		}
+
+	const vector<Vertex> & V = mesh.getVertices ();
+	const vector<Triangle> & T = mesh.getTriangles ();
+	double area = 0;
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < T.size (); i += stride) {
+		double x[3], y[3];
+		bool behind = false;
+		for (unsigned int j = 0; j < 3; j++) {
+			const Vec3Df & p = V[T[i].getVertex (j)].getPos ();
+			double w = m[3]*p[0] + m[7]*p[1] + m[11]*p[2] + m[15];
+			behind = behind || w <= 0;
+			x[j] = (m[0]*p[0] + m[4]*p[1] + m[8]*p[2] + m[12]) / w * viewport[2] / 2;
+			y[j] = (m[1]*p[0] + m[5]*p[1] + m[9]*p[2] + m[13]) / w * viewport[3] / 2;
+		}
+		double a = ((x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0])) / 2;
+		if (!behind && a > 0) {
+			area += a;
+			count++;
+		}
+	}
+	return count ? area / count : 0;
+}
+
+// Picks the sampling of the frame, and binds its shader when it changes
+void updateSampling () {
+	bool wanted = false;
+	if (sampling == PerVertex)
+		wanted = true;
+	else if (sampling == Auto) {
+		float pixels = meanTrianglePixels (mesh.getTriangles ().size () / 4096 + 1);
+		wanted = pixels < (perVertex ? perPixelAbove : perVertexBelow);
+	}
+	if (wanted != perVertex) {
+		perVertex = wanted;
+		if (perVertex)
+			vertexNoiseShader->bind ();
+		else
+			shader->bind ();
+		setShaderValues ();
+	}
+}
+
+// noise: one value per vertex for vertexNoiseShader, or NULL
+void drawMesh (bool flat, const vector<float> * noise = NULL) {
 	const vector<Vertex> & V = mesh.getVertices ();
 	const vector<Triangle> & T = mesh.getTriangles ();
 	glBegin (GL_TRIANGLES);
@@ -185,25 +329,53 @@ void drawMesh (bool flat) {
 			normal.normalize ();
 			glNormalVec3Df (normal);
 		}
-		for (unsigned int j = 0; j < 3; j++) 
+		for (unsigned int j = 0; j < 3; j++) {
+			if (noise)
+				vertexNoiseShader->setNoise ((*noise)[t.getVertex (j)]);
 			if (!flat) {
 				glNormalVec3Df (V[t.getVertex (j)].getNormal ());
 				glVertexVec3Df (V[t.getVertex (j)].getPos ());
 			} else
 				glVertexVec3Df (V[t.getVertex (j)].getPos ());
+		}
 	}
 	glEnd ();
 }
 
 void drawSolidModel () {
+	if (!useDisplayList) {
+		// flat triangles and their edges in one draw, the edges drawn by
+		// the shader (setWireframe)
+		if (perVertex) {
+			vertexNoiseShader->bind ();
+			frameTimer->begin (FrameTimer::Upload);
+			meshBuffers->setNoise (vertexNoiseValues (), true);
+			frameTimer->end (FrameTimer::Upload);
+			meshBuffers->drawFlat (vertexNoiseShader->getBarycentricAttribute (),
+					vertexNoiseShader->getNoiseAttribute ());
+		} else {
+			shader->bind ();
+			meshBuffers->drawFlat (shader->getBarycentricAttribute ());
+		}
+		return;
+	}
+
 	glEnable (GL_LIGHTING);
 	glEnable (GL_COLOR_MATERIAL);
 	glPolygonMode (GL_FRONT_AND_BACK, GL_FILL);
 	glPolygonOffset (1.0, 1.0);
 	glEnable (GL_POLYGON_OFFSET_FILL);
 	glShadeModel (GL_FLAT);
-	shader->bind ();
-	drawMesh (true);    
+	if (perVertex) {
+		vertexNoiseShader->bind ();
+		frameTimer->begin (FrameTimer::Upload);
+		const vector<float> & noise = vertexNoiseValues ();
+		frameTimer->end (FrameTimer::Upload);
+		drawMesh (true, &noise);
+	} else {
+		shader->bind ();
+		drawMesh (true);    
+	}
 	glPolygonMode (GL_FRONT, GL_LINE);
 	glPolygonMode (GL_BACK, GL_FILL);
 	glColor3f (0.0, 0.0, 0.0);
@@ -216,7 +388,24 @@ void drawSolidModel () {
 }
 
 void drawPhongModel () {
-	glCallList (glID);
+	if (!useDisplayList) {
+		if (perVertex) {
+			frameTimer->begin (FrameTimer::Upload);
+			meshBuffers->setNoise (vertexNoiseValues ());
+			frameTimer->end (FrameTimer::Upload);
+			meshBuffers->draw (vertexNoiseShader->getNoiseAttribute ());
+		} else
+			meshBuffers->draw ();
+		return;
+	}
+	// the per-vertex noise changes every frame, it can't live in the list
+	if (perVertex) {
+		frameTimer->begin (FrameTimer::Upload);
+		const vector<float> & noise = vertexNoiseValues ();
+		frameTimer->end (FrameTimer::Upload);
+		drawMesh (false, &noise);
+	} else
+		glCallList (glID);
 }
 
 void initLights () {
@@ -295,6 +484,18 @@ void initGLList () {
 	glEndList ();
 }
 
+// The frame timings as CSV, once
+void writeTrace () {
+	static bool written = false;
+	if (written || !frameTimer || traceFile.empty ())
+		return;
+	written = true;
+	if (frameTimer->writeCSV (traceFile))
+		cout << "Frame timings written to " << traceFile << endl;
+	else
+		cerr << "Cannot write " << traceFile << endl;
+}
+
 void init (const std::string & filename) {
 	glewInit();
 	if (glewGetExtension ("GL_ARB_vertex_shader")        != GL_TRUE ||
@@ -310,12 +511,38 @@ void init (const std::string & filename) {
 
 	camera.resize (SCREENWIDTH, SCREENHEIGHT);
 	glClearColor (0.0, 0.0, 0.0, 1.0);
+	frameTimer = new FrameTimer;
+	// closing the window exits without clear ()
+	atexit (writeTrace);
 
 	initLights ();
 	setSingleSpotLight ();
 	setDefaultMaterial ();
 	mesh = openOFF (filename, 0);
+
+	// both paths are built, 'l' switches between them
+	typedef chrono::steady_clock Clock;
+	Clock::time_point start = Clock::now ();
 	initGLList ();
+	glFinish ();
+	Clock::time_point listDone = Clock::now ();
+	meshBuffers = new MeshBuffers;
+	meshBuffers->upload (mesh);
+	glFinish ();
+	Clock::time_point buffersDone = Clock::now ();
+	cout << "Display list built in "
+		<< chrono::duration<double, milli> (listDone - start).count () << " ms, buffers uploaded in "
+		<< chrono::duration<double, milli> (buffersDone - listDone).count () << " ms" << endl;
+
+	vector<Vec3Df> positions, normals;
+	for (unsigned int i = 0; i < mesh.getVertices ().size (); i++) {
+		positions.push_back (mesh.getVertices ()[i].getPos ());
+		normals.push_back (mesh.getVertices ()[i].getNormal ());
+	}
+	perlinCache = new PerlinSliceCache;
+	perlinCache->setPositions (positions);
+	vertexNoise.setMesh (positions, normals);
+	VertexNoise::setShaderTile (vertexWavelet);
 
 	try {
 		cout << "Binding shaders...\n";
@@ -325,6 +552,8 @@ void init (const std::string & filename) {
 		gaborShader = new GaborShader;
 		cout << "Wavelet...\n";
 		waveletShader = new WaveletShader;
+		cout << "Per-vertex noise...\n";
+		vertexNoiseShader = new VertexNoiseShader;
 		cout << "Setting default values...\n";
 		shader = perlinShader;
 		shader->bind();
@@ -337,9 +566,17 @@ void init (const std::string & filename) {
 }
 
 void clear () {
+	frameTimer->finish ();
+	cout << "Frame timings: " << frameTimer->report () << endl;
+	writeTrace ();
+	delete frameTimer;
+	frameTimer = NULL;
 	delete perlinShader;
 	delete gaborShader;
 	delete waveletShader;
+	delete vertexNoiseShader;
+	delete perlinCache;
+	delete meshBuffers;
 	glDeleteLists (glID, 1);
 }
 
@@ -347,17 +584,30 @@ void reshape(int w, int h) {
 	camera.resize (w, h);
 }
 
-void display () {
+// turn: degrees the model is rotated around its y axis, for the headless poses
+void drawFrame (float turn = 0.0f) {
+	frameTimer->begin (FrameTimer::Submit);
 	glLoadIdentity ();
 	glClear (GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	camera.apply ();
+	glRotatef (turn, 0.0f, 1.0f, 0.0f);
+	updateSampling ();
 	if (mode == Solid)
 		drawSolidModel ();
 	else if (mode == Phong)
 		drawPhongModel ();
+	frameTimer->end (FrameTimer::Submit);
+}
+
+void display () {
+	frameTimer->beginFrame ();
+	drawFrame ();
+	frameTimer->endGpu ();
 	glFlush ();
 	glutSwapBuffers ();
+	frameTimer->begin (FrameTimer::Upload);
 	setShaderValues();
+	frameTimer->end (FrameTimer::Upload);
 }
 
 void idle () {
@@ -372,11 +622,13 @@ void idle () {
 		static char FPSstr [128];
 		unsigned int numOfTriangles = mesh.getTriangles ().size ();
 		if (mode == Solid)
-			sprintf (FPSstr, "gMini: %d tri. - solid shading - %d FPS.",
-					numOfTriangles, FPS);
+			sprintf (FPSstr, "gMini: %d tri. - solid shading%s%s - %d FPS.",
+					numOfTriangles, perVertex ? ", per-vertex noise" : "",
+					useDisplayList ? ", immediate mode" : "", FPS);
 		else if (mode == Phong)
-			sprintf (FPSstr, "gMini: %d tri. - Phong shading - %d FPS.",
-					numOfTriangles, FPS);
+			sprintf (FPSstr, "gMini: %d tri. - Phong shading%s%s - %d FPS.",
+					numOfTriangles, perVertex ? ", per-vertex noise" : "",
+					useDisplayList ? ", display list" : "", FPS);
 		glutSetWindowTitle (FPSstr);
 		lastTime = currentTime;
 
@@ -392,7 +644,15 @@ void printUsage () {
 		<< "--------------------------------------" << endl
 		<< "Author : Tamy Boubekeur (http://www.telecom-paristech.fr/~boubek)" << endl
 		<< "--------------------------------------" << endl 
-		<< "USAGE: ./Main <file>.off" << endl
+		<< "USAGE: ./Main [options] <file>.off" << endl
+		<< " -size WxH      window or frame size (default 1024x768)" << endl
+		<< " -keys string   keyboard commands applied at startup, e.g. Gz for solid Gabor" << endl
+		<< " -headless      no window: render offscreen (EGL), write the frames, print the FPS" << endl
+		<< " -frames n      (HEADLESS) number of frames (default 60)" << endl
+		<< " -turn degrees  (HEADLESS) rotation of the model over the frames (default 360)" << endl
+		<< " -out prefix    (HEADLESS) frames written to <prefix>0000.ppm... (default frame)," << endl
+		<< "                not written if empty" << endl
+		<< " -trace file    frame timings written on exit (default frametimes.csv), none if empty" << endl
 		<< "--------------------------------------" << endl 
 		<< "Keyboard commands" << endl 
 		<< "--------------------------------------" << endl 
@@ -403,6 +663,9 @@ void printUsage () {
 		<< " a: (GABOR) decrease the a parameter" << endl
 		<< " i: (GABOR) isometric noise <--> anisometric noise" << endl
 		<< " w: (GABOR) increase the omega0 (only useful with anisotropic noise)" << endl
+		<< " m: (GABOR) impulses drawn per fragment <--> read from a precomputed atlas" << endl
+		<< " j: (GABOR) Poisson impulses <--> a fixed jittered grid of impulses per cell" << endl
+		<< " z: (GABOR) 2D noise in the xy plane <--> solid 3D noise" << endl
 		<< endl
 		<< " P: Switch to Perlin noise" << endl 
 		<< " O: (PERLIN) increase the number of octaves" << endl
@@ -411,6 +674,7 @@ void printUsage () {
 		<< " e: (PERLIN) decrease the persistence" << endl
 		<< " F: (PERLIN) increase the frequence" << endl
 		<< " f: (PERLIN) decrease the frequence" << endl
+		<< " x: (PERLIN) value noise <--> simplex noise" << endl
 		<<endl
 		<< " W: Switch to Wavelet noise" << endl 
 		<< " B: (WAVELET) increase the number of bands" << endl
@@ -423,6 +687,11 @@ void printUsage () {
 		<< " s: (WAVELET) decrease s" << endl
 		<< " p: (WAVELET) enable/disable noise projection" << endl
 		<<endl
+		<< " v: (ALL) noise per pixel --> per vertex --> automatic" << endl
+		<< " k: (ALL) Phong shading <--> solid: flat shading and wireframe" << endl
+		<< " l: (ALL) model from vertex/index buffers <--> a display list and immediate mode" << endl
+		<< " h: (ALL) print the frame timings: CPU upload and draw submission, GPU, frame" << endl
+		<<endl
 		<< " D: (ALL) increase diffuse ref" << endl
 		<< " d: (ALL) decrease diffuse ref" << endl
 		<< " C: (ALL) increase spec ref" << endl
@@ -490,20 +759,39 @@ void key (unsigned char keyPressed, int x, int y) {
 			iso = !iso;
 			cout << "GABOR: is iso: " << iso << endl;
 			break;
+		case 'm':
+			if (!GLEW_ARB_texture_float) {
+				cout << "GABOR: the impulse atlas needs GL_ARB_texture_float" << endl;
+				break;
+			}
+			impulseAtlas = !impulseAtlas;
+			cout << "GABOR: impulse atlas: " << impulseAtlas << endl;
+			break;
+		case 'j':
+			stratified = !stratified;
+			cout << "GABOR: stratified impulses: " << stratified << endl;
+			break;
+		case 'z':
+			solid = !solid;
+			cout << "GABOR: solid noise: " << solid << endl;
+			break;
 
 			// Noise type
 		case 'P':
 			shader = perlinShader;
+			perVertex = false;
 			shader->bind();
 			cout << "Applied Perlin noise" << endl;
 			break;
 		case 'W':
 			shader = waveletShader;
+			perVertex = false;
 			shader->bind();
 			cout << "Applied Wavelet noise" << endl;
 			break;
 		case 'G':
 			shader = gaborShader;
+			perVertex = false;
 			shader->bind();
 			cout << "Applied Gabor noise" << endl;
 			break;
@@ -572,6 +860,26 @@ void key (unsigned char keyPressed, int x, int y) {
 			f0 = max(1.0, f0 - 1.0);
 			cout << "PERLIN: frequence: " << f0 << endl;
 			break;
+		case 'x':
+			perlinSimplex = !perlinSimplex;
+			cout << "PERLIN: basis: " << (perlinSimplex ? "simplex" : "value") << endl;
+			break;
+		case 'k':
+			mode = (mode == Phong) ? Solid : Phong;
+			cout << (mode == Solid ? "Solid" : "Phong") << " shading" << endl;
+			break;
+		case 'l':
+			useDisplayList = !useDisplayList;
+			cout << "Model drawn from " << (useDisplayList ? "the display list and immediate mode" : "vertex/index buffers") << endl;
+			break;
+		case 'h':
+			cout << "Frame timings: " << frameTimer->report () << endl;
+			break;
+		case 'v':
+			sampling = (NoiseSampling) ((sampling + 1) % 3);
+			cout << "NOISE: sampling: " << (sampling == PerPixel ? "per pixel"
+					: sampling == PerVertex ? "per vertex" : "automatic") << endl;
+			break;
 
 		case '?':
 		default:
@@ -579,7 +887,8 @@ void key (unsigned char keyPressed, int x, int y) {
 			break;
 	}
 	setShaderValues ();
-	idle ();
+	if (!headless)
+		idle ();
 }
 
 void mouse (int button, int state, int x, int y) {
@@ -632,18 +941,124 @@ void usage () {
 	exit (EXIT_FAILURE);
 }
 
+// The model turned by headlessTurn over headlessFrames frames, with the
+// perlin time moving as in the window
+int renderHeadless (const string & filename) {
+	HeadlessContext context;
+	if (!context.create (SCREENWIDTH, SCREENHEIGHT)) {
+		cerr << "No offscreen context: " << context.error () << endl;
+		return EXIT_FAILURE;
+	}
+	init (filename);
+	cout << "Rendering with " << glGetString (GL_RENDERER) << endl;
 
+	glCullFace (GL_BACK);
+	glEnable (GL_CULL_FACE);
+	glDepthFunc (GL_LESS);
+	glEnable (GL_DEPTH_TEST);
+	shader->bind ();
+	for (unsigned int i = 0; i < startupKeys.size (); i++)
+		key (startupKeys[i], 0, 0);
+	setShaderValues ();
+
+	// rendering is timed up to glFinish, apart from the readback and the
+	// files; over the fragments that pass the depth test it is an upper
+	// bound of the cost of one fragment (gmini -headless -keys x compares
+	// the perlin bases)
+	typedef chrono::steady_clock Clock;
+	double renderSeconds = 0;
+	double fragments = 0;
+	GLuint fragmentQuery;
+	glGenQueriesARB (1, &fragmentQuery);
+	Clock::time_point start = Clock::now ();
+	vector<unsigned char> pixels;
+	for (unsigned int i = 0; i < headlessFrames; i++) {
+		Clock::time_point frameStart = Clock::now ();
+		frameTimer->beginFrame ();
+		glBeginQueryARB (GL_SAMPLES_PASSED_ARB, fragmentQuery);
+		drawFrame (headlessTurn * i / headlessFrames);
+		glEndQueryARB (GL_SAMPLES_PASSED_ARB);
+		frameTimer->endGpu ();
+		glFinish ();
+		renderSeconds += chrono::duration<double> (Clock::now () - frameStart).count ();
+		GLuint passed;
+		glGetQueryObjectuivARB (fragmentQuery, GL_QUERY_RESULT_ARB, &passed);
+		fragments += passed;
+		if (!headlessOutput.empty ()) {
+			char name[16];
+			sprintf (name, "%04u.ppm", i);
+			context.readPixels (pixels);
+			if (!context.writePPM (headlessOutput + name, pixels)) {
+				cerr << "Cannot write " << headlessOutput + name << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		perlinTime += headlessTimeStep;
+		frameTimer->begin (FrameTimer::Upload);
+		setShaderValues ();
+		frameTimer->end (FrameTimer::Upload);
+	}
+	double totalSeconds = chrono::duration<double> (Clock::now () - start).count ();
+
+	cout << headlessFrames << " frames of " << SCREENWIDTH << "x" << SCREENHEIGHT << ", "
+		<< mesh.getTriangles ().size () << " tri.: " << headlessFrames / renderSeconds
+		<< " FPS rendering, " << headlessFrames / totalSeconds << " FPS with "
+		<< (headlessOutput.empty () ? "the loop" : "the images written") << endl;
+	cout << fragments / headlessFrames << " fragments a frame, "
+		<< (fragments > 0 ? 1e9 * renderSeconds / fragments : 0) << " ns per fragment" << endl;
+	glDeleteQueriesARB (1, &fragmentQuery);
+	clear ();
+	return EXIT_SUCCESS;
+}
+
+// The options, into the statics above; returns the .off file
+string parseArguments (int argc, char ** argv) {
+	string filename;
+	for (int i = 1; i < argc; i++) {
+		string arg = argv[i];
+		bool hasValue = i+1 < argc;
+		if (arg == "-headless")
+			headless = true;
+		else if (arg == "-size" && hasValue) {
+			if (sscanf (argv[++i], "%ux%u", &SCREENWIDTH, &SCREENHEIGHT) != 2
+					|| SCREENWIDTH == 0 || SCREENHEIGHT == 0)
+				usage ();
+		} else if (arg == "-keys" && hasValue)
+			startupKeys = argv[++i];
+		else if (arg == "-frames" && hasValue)
+			headlessFrames = atoi (argv[++i]);
+		else if (arg == "-turn" && hasValue)
+			headlessTurn = atof (argv[++i]);
+		else if (arg == "-out" && hasValue)
+			headlessOutput = argv[++i];
+		else if (arg == "-trace" && hasValue)
+			traceFile = argv[++i];
+		else if (arg[0] != '-' && filename.empty ())
+			filename = arg;
+		else
+			usage ();
+	}
+	if (filename.empty () || (headless && headlessFrames == 0))
+		usage ();
+	return filename;
+}
 
 int main (int argc, char ** argv) {
-	glutInit (&argc, argv);
+	// glutInit takes out its own options (-display...) first
+	bool windowed = true;
+	for (int i = 1; i < argc; i++)
+		windowed = windowed && string (argv[i]) != "-headless";
+	if (windowed)
+		glutInit (&argc, argv);
+	string filename = parseArguments (argc, argv);
+	if (headless)
+		return renderHeadless (filename);
+
 	glutInitDisplayMode (GLUT_RGBA | GLUT_DEPTH | GLUT_DOUBLE);
 	glutInitWindowSize (SCREENWIDTH, SCREENHEIGHT);
 	window = glutCreateWindow ( "gMini");
 
-	if (argc != 2)
-		usage ();
-
-	init (string (argv[1]));
+	init (filename);
 
 	glCullFace (GL_BACK);
 	glEnable (GL_CULL_FACE);
@@ -660,6 +1075,8 @@ int main (int argc, char ** argv) {
 	glEnable (GL_DEPTH_TEST);
 
 	shader->bind ();
+	for (unsigned int i = 0; i < startupKeys.size (); i++)
+		key (startupKeys[i], 0, 0);
 	setShaderValues();
 	glutMainLoop ();
 	return EXIT_SUCCESS;
@@ -0,0 +1,223 @@
+#include <algorithm>
+
+#include "MeshBuffers.h"
+using namespace std;
+
+/* position, normal */
+static const unsigned int vertexFloats = 6;
+/* position, triangle normal, barycentric coordinates */
+static const unsigned int flatFloats = 9;
+
+static void packVertices(const Mesh &mesh, unsigned int begin, unsigned int end,
+						 vector<float> &data) {
+  const vector<Vertex> &V = mesh.getVertices();
+  data.resize((end-begin)*vertexFloats);
+  float *d = data.data();
+  for (unsigned int i=begin; i<end; i++, d+=vertexFloats) {
+	const Vec3Df &p = V[i].getPos(), &n = V[i].getNormal();
+	d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+	d[3] = n[0]; d[4] = n[1]; d[5] = n[2];
+  }
+}
+
+static void packTriangles(const Mesh &mesh, unsigned int begin, unsigned int end,
+						  vector<GLuint> &data) {
+  const vector<Triangle> &T = mesh.getTriangles();
+  data.resize((end-begin)*3);
+  for (unsigned int i=begin; i<end; i++)
+	for (unsigned int j=0; j<3; j++)
+	  data[(i-begin)*3+j] = T[i].getVertex(j);
+}
+
+static void packFlatTriangles(const Mesh &mesh, unsigned int begin, unsigned int end,
+							  vector<float> &data) {
+  const vector<Vertex> &V = mesh.getVertices();
+  const vector<Triangle> &T = mesh.getTriangles();
+  data.resize((end-begin)*3*flatFloats);
+  float *d = data.data();
+  for (unsigned int i=begin; i<end; i++) {
+	const Vec3Df &p0 = V[T[i].getVertex(0)].getPos();
+	Vec3Df normal = Vec3Df::crossProduct(V[T[i].getVertex(1)].getPos() - p0,
+										 V[T[i].getVertex(2)].getPos() - p0);
+	normal.normalize();
+	for (unsigned int j=0; j<3; j++, d+=flatFloats) {
+	  const Vec3Df &p = V[T[i].getVertex(j)].getPos();
+	  d[0] = p[0]; d[1] = p[1]; d[2] = p[2];
+	  d[3] = normal[0]; d[4] = normal[1]; d[5] = normal[2];
+	  d[6] = j == 0; d[7] = j == 1; d[8] = j == 2;
+	}
+  }
+}
+
+MeshBuffers::MeshBuffers()
+  : vertexBuffer(0), indexBuffer(0), noiseBuffer(0), flatBuffer(0), flatNoiseBuffer(0),
+	vertexCount(0), indexCount(0) {
+}
+
+MeshBuffers::~MeshBuffers() {
+  if (vertexBuffer) {
+	GLuint buffers[5] = {vertexBuffer, indexBuffer, noiseBuffer, flatBuffer, flatNoiseBuffer};
+	glDeleteBuffersARB(5, buffers);
+  }
+}
+
+void MeshBuffers::upload(const Mesh &mesh) {
+  if (!vertexBuffer) {
+	GLuint buffers[5];
+	glGenBuffersARB(5, buffers);
+	vertexBuffer = buffers[0];
+	indexBuffer = buffers[1];
+	noiseBuffer = buffers[2];
+	flatBuffer = buffers[3];
+	flatNoiseBuffer = buffers[4];
+  }
+  vertexCount = mesh.getVertices().size();
+  indexCount = 3*mesh.getTriangles().size();
+
+  vector<float> vertices;
+  packVertices(mesh, 0, vertexCount, vertices);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertexBuffer);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertices.size()*sizeof(float), vertices.data(),
+				  GL_STATIC_DRAW_ARB);
+
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, noiseBuffer);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertexCount*sizeof(float), NULL, GL_STREAM_DRAW_ARB);
+
+  packFlatTriangles(mesh, 0, indexCount/3, vertices);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatBuffer);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, vertices.size()*sizeof(float), vertices.data(),
+				  GL_STATIC_DRAW_ARB);
+
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatNoiseBuffer);
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, indexCount*sizeof(float), NULL, GL_STREAM_DRAW_ARB);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+
+  packTriangles(mesh, 0, indexCount/3, indices);
+  vertexTriangles.assign(vertexCount, vector<unsigned int>());
+  for (unsigned int i=0; i<indexCount; i++)
+	vertexTriangles[indices[i]].push_back(i/3);
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indexBuffer);
+  glBufferDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indices.size()*sizeof(GLuint), indices.data(),
+				  GL_STATIC_DRAW_ARB);
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+}
+
+void MeshBuffers::updateVertices(const Mesh &mesh, unsigned int begin, unsigned int end) {
+  if (begin >= end)
+	return;
+  vector<float> vertices;
+  packVertices(mesh, begin, end, vertices);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertexBuffer);
+  glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, begin*vertexFloats*sizeof(float),
+					 vertices.size()*sizeof(float), vertices.data());
+
+  /* the flat triangles using these vertices, and their normals, a run of
+     consecutive triangles at a time */
+  vector<unsigned int> triangles;
+  for (unsigned int v=begin; v<end; v++)
+	triangles.insert(triangles.end(), vertexTriangles[v].begin(), vertexTriangles[v].end());
+  sort(triangles.begin(), triangles.end());
+  triangles.erase(unique(triangles.begin(), triangles.end()), triangles.end());
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatBuffer);
+  for (unsigned int i=0, j; i<triangles.size(); i=j) {
+	for (j=i+1; j<triangles.size() && triangles[j] == triangles[j-1]+1; j++)
+	  ;
+	packFlatTriangles(mesh, triangles[i], triangles[j-1]+1, vertices);
+	glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, triangles[i]*3*flatFloats*sizeof(float),
+					   vertices.size()*sizeof(float), vertices.data());
+  }
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void MeshBuffers::updateTriangles(const Mesh &mesh, unsigned int begin, unsigned int end) {
+  if (begin >= end)
+	return;
+  vector<GLuint> changed;
+  packTriangles(mesh, begin, end, changed);
+  for (unsigned int i=0; i<changed.size(); i++) {
+	vector<unsigned int> &before = vertexTriangles[indices[begin*3+i]];
+	before.erase(find(before.begin(), before.end(), begin+i/3));
+	vertexTriangles[changed[i]].push_back(begin+i/3);
+	indices[begin*3+i] = changed[i];
+  }
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indexBuffer);
+  glBufferSubDataARB(GL_ELEMENT_ARRAY_BUFFER_ARB, begin*3*sizeof(GLuint),
+					 changed.size()*sizeof(GLuint), changed.data());
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+
+  vector<float> vertices;
+  packFlatTriangles(mesh, begin, end, vertices);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatBuffer);
+  glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, begin*3*flatFloats*sizeof(float),
+					 vertices.size()*sizeof(float), vertices.data());
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void MeshBuffers::setNoise(const vector<float> &noise, bool flat) {
+  const float *values = noise.data();
+  unsigned int count = min((unsigned int)noise.size(), vertexCount);
+  if (flat) {
+	/* the value of each triangle corner */
+	flatNoise.resize(indexCount);
+	for (unsigned int i=0; i<indexCount; i++)
+	  flatNoise[i] = indices[i] < count ? noise[indices[i]] : 0.f;
+	values = flatNoise.data();
+	count = indexCount;
+  }
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flat ? flatNoiseBuffer : noiseBuffer);
+  /* orphans the storage of the last frame instead of waiting for it */
+  glBufferDataARB(GL_ARRAY_BUFFER_ARB, (flat ? indexCount : vertexCount)*sizeof(float), NULL,
+				  GL_STREAM_DRAW_ARB);
+  glBufferSubDataARB(GL_ARRAY_BUFFER_ARB, 0, count*sizeof(float), values);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void MeshBuffers::draw(GLint noiseAttribute) const {
+  const GLsizei stride = vertexFloats*sizeof(float);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, vertexBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (const GLvoid *) 0);
+  glNormalPointer(GL_FLOAT, stride, (const GLvoid *) (3*sizeof(float)));
+  if (noiseAttribute != -1) {
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, noiseBuffer);
+	glEnableVertexAttribArrayARB(noiseAttribute);
+	glVertexAttribPointerARB(noiseAttribute, 1, GL_FLOAT, GL_FALSE, 0, (const GLvoid *) 0);
+  }
+
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, indexBuffer);
+  glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, (const GLvoid *) 0);
+
+  glBindBufferARB(GL_ELEMENT_ARRAY_BUFFER_ARB, 0);
+  if (noiseAttribute != -1)
+	glDisableVertexAttribArrayARB(noiseAttribute);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
+
+void MeshBuffers::drawFlat(GLint barycentricAttribute, GLint noiseAttribute) const {
+  const GLsizei stride = flatFloats*sizeof(float);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatBuffer);
+  glEnableClientState(GL_VERTEX_ARRAY);
+  glEnableClientState(GL_NORMAL_ARRAY);
+  glVertexPointer(3, GL_FLOAT, stride, (const GLvoid *) 0);
+  glNormalPointer(GL_FLOAT, stride, (const GLvoid *) (3*sizeof(float)));
+  glEnableVertexAttribArrayARB(barycentricAttribute);
+  glVertexAttribPointerARB(barycentricAttribute, 3, GL_FLOAT, GL_FALSE, stride,
+						   (const GLvoid *) (6*sizeof(float)));
+  if (noiseAttribute != -1) {
+	glBindBufferARB(GL_ARRAY_BUFFER_ARB, flatNoiseBuffer);
+	glEnableVertexAttribArrayARB(noiseAttribute);
+	glVertexAttribPointerARB(noiseAttribute, 1, GL_FLOAT, GL_FALSE, 0, (const GLvoid *) 0);
+  }
+
+  glDrawArrays(GL_TRIANGLES, 0, indexCount);
+
+  if (noiseAttribute != -1)
+	glDisableVertexAttribArrayARB(noiseAttribute);
+  glDisableVertexAttribArrayARB(barycentricAttribute);
+  glDisableClientState(GL_NORMAL_ARRAY);
+  glDisableClientState(GL_VERTEX_ARRAY);
+  glBindBufferARB(GL_ARRAY_BUFFER_ARB, 0);
+}
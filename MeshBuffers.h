@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+
+#define GLEW_STATIC 1
+#include <GL/glew.h>
+
+#include "Mesh.h"
+
+/*
+The mesh in vertex and index buffer objects, drawn with glDrawElements
+instead of glBegin/glEnd or a display list. The vertices are interleaved,
+position then normal, in one buffer and the triangles fill an index buffer.
+Both are uploaded once; when the geometry changes only the changed range of
+vertices or triangles is sent again, with glBufferSubData. The per-vertex
+noise of VertexNoiseShader is a third buffer, streamed every frame.
+
+The flat shaded copy of the solid mode has three vertices per triangle with
+the triangle normal, computed at upload, and barycentric coordinates for the
+wireframe the shaders draw: solid mode is one glDrawArrays. The triangles
+around each vertex are kept from upload() on, so moving vertices re-sends
+only the flat triangles that use them, one glBufferSubData per run of
+consecutive triangles.
+*/
+class MeshBuffers {
+  public:
+    MeshBuffers();
+    ~MeshBuffers();
+
+    /* Every vertex and triangle of the mesh, replacing the previous ones */
+    void upload(const Mesh &mesh);
+
+    /* Vertices / triangles [begin, end) changed in the mesh; the counts
+       must be those of the last upload() */
+    void updateVertices(const Mesh &mesh, unsigned int begin, unsigned int end);
+    void updateTriangles(const Mesh &mesh, unsigned int begin, unsigned int end);
+
+    /* One value per vertex, for the attribute given to draw(), or to
+       drawFlat() when flat */
+    void setNoise(const std::vector<float> &noise, bool flat=false);
+
+    /* gl_Vertex and gl_Normal from the buffers, and the noise values on the
+       generic attribute noiseAttribute unless it is -1 */
+    void draw(GLint noiseAttribute=-1) const;
+
+    /* The flat shaded triangles, their barycentric coordinates on
+       barycentricAttribute */
+    void drawFlat(GLint barycentricAttribute, GLint noiseAttribute=-1) const;
+
+  private:
+    MeshBuffers(const MeshBuffers &);
+    MeshBuffers &operator= (const MeshBuffers &);
+
+    GLuint vertexBuffer, indexBuffer, noiseBuffer;
+    GLuint flatBuffer, flatNoiseBuffer;
+    unsigned int vertexCount, indexCount;
+    std::vector<GLuint> indices;    // the index buffer, for the flat copy
+    std::vector<std::vector<unsigned int> > vertexTriangles; // the triangles using each vertex
+    std::vector<float> flatNoise;
+};
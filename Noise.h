@@ -1,12 +1,14 @@
 #pragma once
 
+#include <string>
 #include <vector>
+#include <stddef.h>
+#include <stdint.h>
 
 #include "Vec3D.h"
 
 /*
 TODO:
-Gabor,
 Smooth for perlin 3/4D?
 Uniformize: noise.compute(Vec3Df, time); \\ noise.compute(Vec3Df) \\ noise.compute(Vec3Df, Vec3Df)
 */
@@ -16,11 +18,18 @@ class Noise {
     static const unsigned int gaussianNoiseIterations = 100;
 
   public:
+    /* The stateful draws come from a per-thread counter stream; seedStream()
+       restarts the calling thread's stream. */
+    static void seedStream(uint64_t s);
     static float uniform(); //[-1,1]
     static float uniform(float a, float b);
-    static float gaussianNoise(); //mean = 0, var = 1
+    static float gaussianNoise(); //mean = 0, var = 1/(3*gaussianNoiseIterations)
     static float gaussianNoise(float var, float mean=0);
 
+    /* Stateless draws keyed by (seed, index), safe to call from any thread */
+    static float uniformAt(uint64_t seed, uint64_t index); //[-1,1]
+    static float gaussianNoiseAt(uint64_t seed, uint64_t index);
+
     static float cosineInterpolation(float a, float b, float x);
 
     static float octave(unsigned int i) {
@@ -43,22 +52,41 @@ class Wavelet: public Noise {
   private:
     int noiseTileSize;
     float gaussianClamp;
+    unsigned int seed;
+    void *noiseTileMapping; // set when noiseTileData points into a mapped cache file
+    size_t noiseTileMappingSize;
+    float *ownedNoiseTile;  // set when noiseTileData points to our own copy
 
   public:
     float s;
     int firstBand;
-    float *noiseTileData;
+    const float *noiseTileData; // read-only: may be the pages of the cache file
     std::vector<float > w;
 
-    Wavelet(int n) {
-      generateNoiseTile(n, 4.f);
+    /* The tile is generated once, with the Gaussian clamp, or 4 when
+       clamp is not positive */
+    Wavelet(int n, unsigned int seed=0, float clamp=4.f)
+      : gaussianClamp(4.f), seed(seed), noiseTileMapping(NULL), noiseTileMappingSize(0),
+        ownedNoiseTile(NULL), noiseTileData(NULL) {
+      generateNoiseTile(n, clamp);
       s = 0.f;
       firstBand = -5;
       setW(5, octave);
     }
 
     ~Wavelet() {
-      delete[] noiseTileData;
+      releaseNoiseTile();
+    }
+
+    /* Directory of the shared tile cache (see TileCache.h); tiles found
+       there are mapped read-only instead of generated, missing ones are
+       generated and written. Empty disables the cache. Defaults to
+       $WAVELET_TILE_CACHE. */
+    static void setTileCache(const std::string &directory) {
+      tileCache() = directory;
+    }
+    static const std::string &getTileCache() {
+      return tileCache();
     }
 
     void generateNoiseTile(int n, float clamp=0.f) {
@@ -70,10 +98,18 @@ class Wavelet: public Noise {
 
     void generateNoiseTile();
 
+    /* Uses a copy of the n^3 coefficients in data as the tile */
+    void setNoiseTile(int n, const float *data);
+
     void varClamp(float i) {
       generateNoiseTile(noiseTileSize, gaussianClamp+i);
     }
 
+    void setSeed(unsigned int s) {
+      seed = s;
+      generateNoiseTile();
+    }
+
     void generateGreaterTile() {
       generateNoiseTile(noiseTileSize+2);
     }
@@ -104,12 +140,85 @@ class Wavelet: public Noise {
       return multibandNoise(p, &normal);
     }
 
-    int getNoiseTileSize() { return noiseTileSize; }
-    float getNoiseClamp() { return gaussianClamp; }
+    /* What multibandNoise derives from (w, firstBand, s) for one projection
+       mode, computed once: q = scale[b]*p for the active bands, and the
+       final division that brings the variance to 1. Rebuild it whenever
+       w, firstBand or s change. The overloads with a normal take a
+       projected plan, the others a 3D one; a mismatch asserts. */
+    struct BandPlan {
+      std::vector<float> scale;
+      std::vector<float> weight;
+      double normalization;
+      bool projected;
+    };
+
+    BandPlan bandPlan(bool projected) const;
+
+    float multibandNoise(const BandPlan &plan, const Vec3Df &p);
+    float multibandNoise(const BandPlan &plan, const Vec3Df &p, const Vec3Df &normal);
+
+    /* Batch versions over structure-of-arrays positions (and normals for a
+       projected plan); each band runs over a whole block of points. They
+       give the same floats as multibandNoise(p[, normal]). */
+    void multibandNoise(const BandPlan &plan, const float *x, const float *y,
+                        const float *z, float *result, unsigned int count);
+    void multibandNoise(const BandPlan &plan, const float *x, const float *y,
+                        const float *z, const float *nx, const float *ny,
+                        const float *nz, float *result, unsigned int count);
+
+    /* Value and analytic gradient with respect to p in one pass over the
+       coefficients. The value matches multibandNoise bit for bit, when
+       projected that of the scalar row kernel (to float rounding with
+       AVX2). */
+    float multibandNoiseGradient(const BandPlan &plan, const Vec3Df &p, Vec3Df &gradient);
+    float multibandNoiseGradient(const BandPlan &plan, const Vec3Df &p,
+                                 const Vec3Df &normal, Vec3Df &gradient);
+
+    int getNoiseTileSize() const { return noiseTileSize; }
+    float getNoiseClamp() const { return gaussianClamp; }
+    unsigned int getSeed() const { return seed; }
+
+    float wNoise(const Vec3Df &p);
+    float wProjectedNoise(const Vec3Df &p, const Vec3Df &normal);
+    /* The gradient evaluators agree with central differences of step
+       gradientStep to within gradientError, measured by bench_noise -check */
+    static const float gradientStep, gradientError;
+    float wNoiseGradient(const Vec3Df &p, Vec3Df &gradient);
+    float wProjectedNoiseGradient(const Vec3Df &p, const Vec3Df &normal, Vec3Df &gradient);
+
+    /* Evaluates wNoise at count points given as structure-of-arrays and
+       writes the values to result. Uses AVX-512/AVX2 gathers when the CPU
+       has them and matches the scalar path bit for bit for |p[i]| < 2^22. */
+    void wNoise(const float *x, const float *y, const float *z,
+                float *result, unsigned int count);
+
+    /* Quadratic B-spline on [0,3] */
+    static float bspline(float t) {
+      float t1=t-1, t2=2-t, t3=3-t;
+      return (t<=0||t>=3)? 0 : (t<1) ? t*t/2 : (t<2)? 1-(t1*t1+t2*t2)/2 : t3*t3/2;
+    }
+    static float bsplineDerivative(float t) {
+      return (t<=0||t>=3)? 0 : (t<1) ? t : (t<2)? 3-2*t : t-3;
+    }
+
+    /* Per-query setup of wProjectedNoise: the coefficient bounds, and the
+       terms that make the basis argument of axis i, for coefficient c,
+       A[i] + c[i] - h[i]*(normal.c). */
+    static void projectedSetup(const Vec3Df &p, const Vec3Df &normal, int *min, int *max,
+                               float *A, float *h, float *slope);
+
+    /* Narrows [lo,hi] to the c0 of a row where all three basis arguments
+       base[i]+slope[i]*c0 lie in (0,3); false if none do. */
+    static bool clipSupport(const float *base, const float *slope, float &lo, float &hi);
 
   private:
-    float random() {
-      float noise = Noise::gaussianNoise(gaussianClamp);
+    static std::string &tileCache();
+    void releaseNoiseTile();
+    bool mapNoiseTile(const std::string &path);
+
+    /* Tile cell i is a function of (seed, i) only */
+    float random(int i) {
+      float noise = gaussianClamp * Noise::gaussianNoiseAt(seed, i);
 
       return (noise<-1.f)?-1.f:((noise>1.f)?1.f:noise);
       //	return uniform();
@@ -120,10 +229,8 @@ class Wavelet: public Noise {
       return (m<0) ? m+n : m;
     }
 
-    static void downsample (float *from, float *to, int n, int stride);
-    static void upsample( float *from, float *to, int n, int stride);
+    static void downsample (float *from, float *to, int n, int stride, int count=1);
+    static void upsample( float *from, float *to, int n, int stride, int count=1);
 
-    float wNoise(const Vec3Df &p);
-    float wProjectedNoise(const Vec3Df &p, const Vec3Df &normal);
     float multibandNoise(const Vec3Df &p, const Vec3Df *normal);
 };
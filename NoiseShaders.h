@@ -3,6 +3,35 @@
 
 static Wavelet wNoise(2);
 
+// A uniform of the program and the value last sent to it. Programs keep
+// their uniforms across binds, so sending the same value again is skipped:
+// setShaderValues runs every frame but only reaches GL for what changed.
+template <class T>
+class Uniform {
+	public:
+		Uniform () : location (-1), sent (false) {}
+
+		void init (GLint l) {
+			location = l;
+			sent = false;
+		}
+
+		// true the first time and whenever v differs from the last value
+		bool changed (T v) {
+			if (sent && v == value)
+				return false;
+			value = v;
+			sent = true;
+			return true;
+		}
+
+		GLint location;
+
+	private:
+		T value;
+		bool sent;
+};
+
 class PhongShader : public Shader
 {
 	public:
@@ -11,32 +40,50 @@ class PhongShader : public Shader
 
 		// BRDF properties
 		void setDiffuseRef (float s) {
-			glUniform1fARB (diffuseRefLocation, s); 
+			if (diffuseRef.changed (s))
+				glUniform1fARB (diffuseRef.location, s); 
 		}
 
 		void setSpecRef (float s) {
-			glUniform1fARB (specRefLocation, s); 
+			if (specRef.changed (s))
+				glUniform1fARB (specRef.location, s); 
 		}
 
 		void setShininess (float s) {
-			glUniform1fARB (shininessLocation, s); 
+			if (shininess.changed (s))
+				glUniform1fARB (shininess.location, s); 
 		}
+
+		// black triangle edges, from the barycentricCoords attribute
+		void setWireframe (bool w) {
+			if (wireframe.changed (w))
+				glUniform1iARB (wireframe.location, w);
+		}
+
+		// for a barycentric attribute array (MeshBuffers::drawFlat)
+		GLint getBarycentricAttribute () const { return barycentricLocation; }
 	protected:
 		void init (const std::string & vertexShaderFilename,
 				const std::string & fragmentShaderFilename) {
 			loadFromFile (vertexShaderFilename, fragmentShaderFilename);
 
 			// brdf uniform var
-			specRefLocation = getUniLoc ("specRef");
-			diffuseRefLocation = getUniLoc ("diffuseRef");
-			shininessLocation = getUniLoc ("shininess");
+			specRef.init (getUniLoc ("specRef"));
+			diffuseRef.init (getUniLoc ("diffuseRef"));
+			shininess.init (getUniLoc ("shininess"));
+			wireframe.init (getUniLoc ("wireframe"));
+			barycentricLocation = glGetAttribLocationARB (getShaderProgram (), "barycentricCoords");
+			if (barycentricLocation == -1)
+				throw ShaderException ("No such attribute named barycentricCoords");
 		}
 
 	private:
 		// brdf
-		GLint diffuseRefLocation;
-		GLint specRefLocation;
-		GLint shininessLocation;
+		Uniform<float> diffuseRef;
+		Uniform<float> specRef;
+		Uniform<float> shininess;
+		Uniform<bool> wireframe;
+		GLint barycentricLocation;
 };
 
 class PerlinShader : public PhongShader {
@@ -46,19 +93,29 @@ class PerlinShader : public PhongShader {
 
 		// Perlin properties
 		void setnbOctave (int s) {
-			glUniform1iARB (nbOctaveLocation, s); 
+			if (nbOctave.changed (s))
+				glUniform1iARB (nbOctave.location, s); 
 		}
 
 		void setF0 (float s) {
-			glUniform1fARB (f0Location, s); 
+			if (f0.changed (s))
+				glUniform1fARB (f0.location, s); 
 		}   
 
 		void setPersistence (float s) {
-			glUniform1fARB (persistenceLocation, s); 
+			if (persistence.changed (s))
+				glUniform1fARB (persistence.location, s); 
 		}
 
 		void setTime(float t) {
-			glUniform1fARB(timeLocation, t);
+			if (time.changed (t))
+				glUniform1fARB(time.location, t);
+		}
+
+		// 0: value noise, 1: simplex noise (Perlin::Basis)
+		void setBasis (int b) {
+			if (basis.changed (b))
+				glUniform1iARB (basis.location, b);
 		}
 
 	private:
@@ -67,17 +124,56 @@ class PerlinShader : public PhongShader {
 			PhongShader::init(vertexShaderFilename, fragmentShaderFilename);
 
 			// perlin uniform var
-			nbOctaveLocation = getUniLoc ("octave");
-			persistenceLocation = getUniLoc ("persistence");
-			f0Location = getUniLoc ("f0");
-			timeLocation = getUniLoc("t");
+			nbOctave.init (getUniLoc ("octave"));
+			persistence.init (getUniLoc ("persistence"));
+			f0.init (getUniLoc ("f0"));
+			time.init (getUniLoc("t"));
+			basis.init (getUniLoc ("basis"));
 		}
 
 		// perlin
-		GLint nbOctaveLocation;
-		GLint persistenceLocation;
-		GLint f0Location;
-		GLint timeLocation;
+		Uniform<int> nbOctave;
+		Uniform<float> persistence;
+		Uniform<float> f0;
+		Uniform<float> time;
+		Uniform<int> basis;
+};
+
+// Noise computed on the CPU and passed per vertex (VertexNoise, PerlinSliceCache)
+class VertexNoiseShader : public PhongShader {
+	public:
+		VertexNoiseShader () { init ("shaderVertexNoise.vert", "shaderVertexNoise.frag"); }
+		inline virtual ~VertexNoiseShader() {}
+
+		typedef enum {PerlinNoise = 0, WaveletNoise = 1, GaborNoise = 2} NoiseType;
+
+		// which shader's coloring to apply
+		void setNoiseType (NoiseType t) {
+			if (noiseType.changed (t))
+				glUniform1iARB (noiseType.location, t);
+		}
+
+		// between glBegin and glEnd, before the vertex
+		void setNoise (float n) {
+			glVertexAttrib1fARB (noiseLocation, n);
+		}
+
+		// for a noise attribute array (MeshBuffers::draw)
+		GLint getNoiseAttribute () const { return noiseLocation; }
+
+	private:
+		void init (const std::string & vertexShaderFilename,
+				const std::string & fragmentShaderFilename) {
+			PhongShader::init(vertexShaderFilename, fragmentShaderFilename);
+
+			noiseType.init (getUniLoc ("noiseType"));
+			noiseLocation = glGetAttribLocationARB (getShaderProgram (), "noiseValue");
+			if (noiseLocation == -1)
+				throw ShaderException ("No such attribute named noiseValue");
+		}
+
+		Uniform<int> noiseType;
+		GLint noiseLocation;
 };
 
 class WaveletShader : public PhongShader
@@ -88,25 +184,32 @@ class WaveletShader : public PhongShader
 
 		// Wavelet properties
 		void setnBandsRef (int s) {
-			glUniform1iARB (nBandsLocation, s); 
+			if (nBands.changed (s))
+				glUniform1iARB (nBands.location, s); 
 		}
 
 		void setfirstBand (int s) {
-			glUniform1iARB (firstBandLocation, s); 
+			if (firstBand.changed (s))
+				glUniform1iARB (firstBand.location, s); 
 		}
 
+		// the tile is only regenerated when its size changes
 		void setTileSize (int s) {
+			if (!tileSize.changed (s))
+				return;
 			wNoise.generateNoiseTile(s);
-			glUniform1iARB (tileSizeLocation, s); 
+			glUniform1iARB (tileSize.location, s); 
 			setNoiseData(s);
 		}
 
 		void setNoiseprojected (bool s) {
-			glUniform1fARB (noiseProjectedLocation, s); 
+			if (noiseProjected.changed (s))
+				glUniform1fARB (noiseProjected.location, s); 
 		}
 
 		void sets (float s) {
-			glUniform1fARB (sLocation, s); 
+			if (sRef.changed (s))
+				glUniform1fARB (sRef.location, s); 
 		}
 
 	private:
@@ -115,14 +218,17 @@ class WaveletShader : public PhongShader
 			PhongShader::init(vertexShaderFilename, fragmentShaderFilename);
 
 			// wavelet uniform var
+			// the shader has its tile hard-coded: no noiseData nor
+			// noiseTileSize uniform yet, -1 makes GL ignore the uploads
 			//arrayLocation = getUniLoc ("noiseData");
-			nBandsLocation = getUniLoc ("nbands");
-			firstBandLocation = getUniLoc ("firstBand");
-			//tileSizeLocation = getUniLoc ("noiseTileSize");
-			noiseProjectedLocation = getUniLoc ("noiseProjected");
-			sLocation = getUniLoc ("s");
-      setNoiseData(2);
-			glUniform1iARB (tileSizeLocation, 2);
+			arrayLocation = -1;
+			nBands.init (getUniLoc ("nbands"));
+			firstBand.init (getUniLoc ("firstBand"));
+			//tileSize.init (getUniLoc ("noiseTileSize"));
+			tileSize.init (-1);
+			noiseProjected.init (getUniLoc ("noiseProjected"));
+			sRef.init (getUniLoc ("s"));
+			setTileSize (2);
 		}
 
 		void setNoiseData(int s) {
@@ -131,33 +237,65 @@ class WaveletShader : public PhongShader
 
 		// wavelet
 		GLint arrayLocation;
-		GLint nBandsLocation;
-		GLint firstBandLocation;
-		GLint tileSizeLocation;
-		GLint noiseProjectedLocation;
-		GLint sLocation;
+		Uniform<int> nBands;
+		Uniform<int> firstBand;
+		Uniform<int> tileSize;
+		Uniform<bool> noiseProjected;
+		Uniform<float> sRef;
 };
 
 class GaborShader : public PhongShader {
 	public:
-		GaborShader () { init ("shader.vert", "shaderGabor.frag"); }
-		inline virtual ~GaborShader() {}
+		GaborShader () : atlasTexture (0) { init ("shader.vert", "shaderGabor.frag"); }
+		inline virtual ~GaborShader() {
+			if (atlasTexture)
+				glDeleteTextures (1, &atlasTexture);
+		}
 
 		// Gabor properties
 		void setKRef (float s) {
-			glUniform1fARB (KRefLocation, s); 
+			if (KRef.changed (s))
+				glUniform1fARB (KRef.location, s); 
 		}
 
 		void setARef (float s) {
-			glUniform1fARB (ARefLocation, s); 
+			if (ARef.changed (s))
+				glUniform1fARB (ARef.location, s); 
 		}
 
 		void setOmegaRef (float s) {
-			glUniform1fARB (OmegaRefLocation, s); 
+			if (OmegaRef.changed (s))
+				glUniform1fARB (OmegaRef.location, s); 
 		}
 
 		void setIsoRef (bool s) {
-			glUniform1fARB (IsoRefLocation, s); 
+			if (IsoRef.changed (s))
+				glUniform1fARB (IsoRef.location, s); 
+		}
+
+		// Impulses read from Gabor::impulseAtlas on texture unit 0 instead of
+		// drawn per fragment. The atlas only changes with iso.
+		void setImpulseAtlas (bool enabled, bool iso) {
+			if (enabled && (!atlasTexture || iso != atlasIso))
+				buildAtlas (iso);
+			if (atlasTexture) {
+				glActiveTextureARB (GL_TEXTURE0_ARB);
+				glBindTexture (GL_TEXTURE_2D, atlasTexture);
+			}
+			if (impulseAtlas.changed (enabled))
+				glUniform1iARB (impulseAtlas.location, enabled);
+		}
+
+		// Gabor::stratified, takes over the atlas
+		void setStratified (bool s) {
+			if (stratified.changed (s))
+				glUniform1iARB (stratified.location, s);
+		}
+
+		// 3D noise over the object coordinates, Poisson impulses only
+		void setSolid (bool s) {
+			if (solid.changed (s))
+				glUniform1iARB (solid.location, s);
 		}
 
 	private:
@@ -166,17 +304,59 @@ class GaborShader : public PhongShader {
 			PhongShader::init(vertexShaderFilename, fragmentShaderFilename);
 
 			// gabor uniform var
-			KRefLocation = getUniLoc ("K");
-			OmegaRefLocation = getUniLoc ("omega_0");
-			ARefLocation = getUniLoc ("a");
-			IsoRefLocation = getUniLoc ("iso");
+			KRef.init (getUniLoc ("K"));
+			OmegaRef.init (getUniLoc ("omega_0"));
+			ARef.init (getUniLoc ("a"));
+			IsoRef.init (getUniLoc ("iso"));
+			impulseAtlas.init (getUniLoc ("impulseAtlas"));
+			atlasLocation = getUniLoc ("atlas");
+			atlasPeriodLocation = getUniLoc ("atlasPeriod");
+			atlasSlotsLocation = getUniLoc ("atlasSlots");
+			stratified.init (getUniLoc ("stratified"));
+			solid.init (getUniLoc ("solid"));
+		}
+
+		void buildAtlas (bool iso) {
+			// the shader's constants: the impulses don't depend on K, a or omega_0
+			Gabor gabor (1.f, 0.05f, 0.f, iso);
+			GLint maxSize;
+			glGetIntegerv (GL_MAX_TEXTURE_SIZE, &maxSize);
+			unsigned int period = 64, slots;
+			std::vector<float> texels;
+			for (;;) {
+				gabor.impulseAtlas (period, texels, slots);
+				if (period*slots <= (unsigned int) maxSize || period == 1)
+					break;
+				period /= 2;
+			}
+
+			if (!atlasTexture)
+				glGenTextures (1, &atlasTexture);
+			glActiveTextureARB (GL_TEXTURE0_ARB);
+			glBindTexture (GL_TEXTURE_2D, atlasTexture);
+			glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+			glTexParameteri (GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			glTexImage2D (GL_TEXTURE_2D, 0, GL_RGBA32F_ARB, period*slots, period, 0,
+					GL_RGBA, GL_FLOAT, &texels[0]);
+			glUniform1iARB (atlasLocation, 0);
+			glUniform1iARB (atlasPeriodLocation, period);
+			glUniform1iARB (atlasSlotsLocation, slots);
+			atlasIso = iso;
 		}
 
 		// gabor
-		GLint KRefLocation;
-		GLint ARefLocation;
-		GLint OmegaRefLocation;
-		GLint IsoRefLocation;
+		Uniform<float> KRef;
+		Uniform<float> ARef;
+		Uniform<float> OmegaRef;
+		Uniform<bool> IsoRef;
+		Uniform<bool> impulseAtlas;
+		GLint atlasLocation;
+		GLint atlasPeriodLocation;
+		GLint atlasSlotsLocation;
+		Uniform<bool> stratified;
+		Uniform<bool> solid;
+		GLuint atlasTexture;
+		bool atlasIso;
 };
 
 #endif // ifndef NOISE_SHADERS_H
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/*
+Minimal fork/join helper for the CPU noise code. Work is handed out in chunks
+of `grain` items from a shared counter, so uneven chunks balance themselves.
+*/
+
+inline unsigned int &threadCountSetting() {
+  static unsigned int count = 0; // 0 = one thread per hardware thread
+  return count;
+}
+
+inline void setThreadCount(unsigned int count) {
+  threadCountSetting() = count;
+}
+
+inline unsigned int threadCount() {
+  unsigned int count = threadCountSetting();
+  if (!count)
+    count = std::thread::hardware_concurrency();
+  return count ? count : 1;
+}
+
+/* Calls f(begin, end) on disjoint ranges covering [0, count). */
+template <typename F>
+void parallelFor(unsigned int count, unsigned int grain, F f) {
+  if (!grain)
+    grain = 1;
+  unsigned int nthreads = std::min(threadCount(), (count+grain-1)/grain);
+  if (nthreads <= 1) {
+    if (count)
+      f(0u, count);
+    return;
+  }
+
+  std::atomic<unsigned int> next(0);
+  auto worker = [&]() {
+    for (;;) {
+      unsigned int begin = next.fetch_add(grain);
+      if (begin >= count)
+        break;
+      f(begin, std::min(begin+grain, count));
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < nthreads; i++)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
@@ -0,0 +1,257 @@
+#include <cmath>
+#include <stdint.h>
+
+#include "Perlin.h"
+#include "Simd.h"
+using namespace std;
+
+static const uint32_t strideX = Perlin::StrideX, strideY = Perlin::StrideY;
+static const uint32_t strideZ = Perlin::StrideZ, strideT = Perlin::StrideT;
+
+/* Skew/unskew factors of the 4D simplex grid, (sqrt(5)-1)/4 and (5-sqrt(5))/20 */
+static const float F4 = 0.309016994f, G4 = 0.138196601f;
+
+/* Dot product of d with gradient h&31 of the hash bits 8..12: bits 3-4 pick
+   the zero axis, bits 0-2 the signs of the three others, in axis order. */
+static inline float gradientDot(uint32_t h, const float *d) {
+  h = (h >> 8) & 31;
+  int zero = h >> 3, bit = 0;
+  float result = 0.f;
+  for (int a=0; a<4; a++) { // branch free: the hash bits are random
+	float sign = (a == zero) ? 0.f : 1.f - 2.f*((h >> bit) & 1);
+	result += sign * d[a];
+	bit += (a != zero);
+  }
+  return result;
+}
+
+float Perlin::simplexNoise(float x, float y, float z, float t) {
+  const float p[4] = {x, y, z, t};
+  float s = (x+y+z+t) * F4;
+  float cell[4], d0[4];
+  int c[4], rank[4] = {0, 0, 0, 0};
+
+  for (int a=0; a<4; a++)
+	cell[a] = floor(p[a]+s);
+  float u = (cell[0]+cell[1]+cell[2]+cell[3]) * G4;
+  for (int a=0; a<4; a++) {
+	c[a] = cell[a];
+	d0[a] = p[a] - (cell[a]-u);
+  }
+
+  /* The simplex holding p steps along the axes by decreasing offset; ties
+	 break as the shader's step() does. */
+  for (int a=0; a<4; a++)
+	for (int b=a+1; b<4; b++) {
+	  if (d0[a] >= d0[b]) rank[a]++;
+	  else rank[b]++;
+	}
+
+  static const uint32_t stride[4] = {strideX, strideY, strideZ, strideT};
+  float result = 0.f;
+  for (int k=0; k<5; k++) {
+	float d[4];
+	uint32_t n = 0;
+	for (int a=0; a<4; a++) {
+	  int step = (k == 4) ? 1 : (rank[a] >= 4-k);
+	  d[a] = d0[a] - step + k*G4;
+	  n += (uint32_t)(c[a]+step) * stride[a];
+	}
+	float w = 0.6f - (d[0]*d[0] + d[1]*d[1] + d[2]*d[2] + d[3]*d[3]);
+	if (w > 0.f) {
+	  w *= w;
+	  result += w * w * gradientDot(Perlin::latticeBits(n), d);
+	}
+  }
+  return 27.f * result;
+}
+
+float Perlin::finalAmplitude() const {
+  float amplitude = 1.f;
+  for (int i=0; i<=octave; i++)
+	amplitude *= persistence;
+  return amplitude;
+}
+
+#if NOISE_SIMD
+NOISE_AVX2
+static inline __m256 interpolateAVX2(__m256 a, __m256 b, __m256 f) {
+  return _mm256_add_ps(_mm256_mul_ps(a, _mm256_sub_ps(_mm256_set1_ps(1.f), f)),
+					   _mm256_mul_ps(b, f));
+}
+
+NOISE_AVX2
+static inline __m256i latticeBitsAVX2(__m256i n) {
+  n = _mm256_xor_si256(_mm256_slli_epi32(n, 13), n);
+  __m256i m = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_mullo_epi32(n, n), _mm256_set1_epi32(15731)),
+							   _mm256_set1_epi32(789221));
+  m = _mm256_add_epi32(_mm256_mullo_epi32(n, m), _mm256_set1_epi32(1376312589));
+  return _mm256_and_si256(m, _mm256_set1_epi32(0x7fffffff));
+}
+
+NOISE_AVX2
+static inline __m256 hashAVX2(__m256i n) {
+  return _mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(_mm256_cvtepi32_ps(latticeBitsAVX2(n)),
+														  _mm256_set1_ps(1.f/1073741824.f)));
+}
+
+/* One octave of InterpolatedNoise4D for eight points sharing t: the 16
+   lattice hashes and 15 interpolations run across the lanes. */
+template <class Interpolation>
+NOISE_AVX2
+static inline __m256 interpolatedNoiseAVX2(__m256 x, __m256 y, __m256 z, float t) {
+  __m256 fx = _mm256_floor_ps(x), fy = _mm256_floor_ps(y), fz = _mm256_floor_ps(z);
+  __m256i base = _mm256_add_epi32(
+	_mm256_add_epi32(_mm256_mullo_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(strideX)),
+					 _mm256_mullo_epi32(_mm256_cvttps_epi32(fy), _mm256_set1_epi32(strideY))),
+	_mm256_mullo_epi32(_mm256_cvttps_epi32(fz), _mm256_set1_epi32(strideZ)));
+  __m256 wx = Interpolation::weight(_mm256_sub_ps(x, fx));
+  __m256 wy = Interpolation::weight(_mm256_sub_ps(y, fy));
+  __m256 wz = Interpolation::weight(_mm256_sub_ps(z, fz));
+  int it = floor(t);
+  __m256 wt = Interpolation::weight(_mm256_set1_ps(t-it));
+  const __m256i dx = _mm256_set1_epi32(strideX), dy = _mm256_set1_epi32(strideY);
+  __m256 v3[2];
+
+  for (int dt=0; dt<2; dt++) {
+	__m256 v2[2];
+	for (int dz=0; dz<2; dz++) {
+	  __m256i n = _mm256_add_epi32(base, _mm256_set1_epi32(dz*strideZ + (uint32_t)(it+dt)*strideT));
+	  __m256i ny = _mm256_add_epi32(n, dy);
+	  __m256 i1 = interpolateAVX2(hashAVX2(n), hashAVX2(_mm256_add_epi32(n, dx)), wx);
+	  __m256 i2 = interpolateAVX2(hashAVX2(ny), hashAVX2(_mm256_add_epi32(ny, dx)), wx);
+	  v2[dz] = interpolateAVX2(i1, i2, wy);
+	}
+	v3[dt] = interpolateAVX2(v2[0], v2[1], wz);
+  }
+  return interpolateAVX2(v3[0], v3[1], wt);
+}
+
+/* Lane-wise gradientDot: the sign of an axis is its hash bit, xor-ed into
+   the float sign, and the zero axis is masked out. */
+NOISE_AVX2
+static inline __m256 gradientDotAVX2(__m256i h, const __m256 *d) {
+  const __m256i one = _mm256_set1_epi32(1);
+  h = _mm256_and_si256(_mm256_srli_epi32(h, 8), _mm256_set1_epi32(31));
+  __m256i zero = _mm256_srli_epi32(h, 3), bit = _mm256_setzero_si256();
+  __m256 result = _mm256_setzero_ps();
+  for (int a=0; a<4; a++) {
+	__m256i isZero = _mm256_cmpeq_epi32(zero, _mm256_set1_epi32(a));
+	__m256i sign = _mm256_slli_epi32(_mm256_and_si256(_mm256_srlv_epi32(h, bit), one), 31);
+	__m256 v = _mm256_xor_ps(d[a], _mm256_castsi256_ps(sign));
+	result = _mm256_add_ps(result, _mm256_andnot_ps(_mm256_castsi256_ps(isZero), v));
+	bit = _mm256_add_epi32(bit, _mm256_andnot_si256(isZero, one));
+  }
+  return result;
+}
+
+/* Perlin::simplexNoise for eight points sharing t, same operation order */
+NOISE_AVX2
+static inline __m256 simplexNoiseAVX2(__m256 x, __m256 y, __m256 z, float t) {
+  const __m256 p[4] = {x, y, z, _mm256_set1_ps(t)};
+  const uint32_t stride[4] = {strideX, strideY, strideZ, strideT};
+  __m256 s = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(p[0], p[1]), p[2]), p[3]),
+						   _mm256_set1_ps(F4));
+  __m256 cell[4], d0[4];
+  __m256i c[4], rank[4];
+
+  for (int a=0; a<4; a++) {
+	cell[a] = _mm256_floor_ps(_mm256_add_ps(p[a], s));
+	rank[a] = _mm256_setzero_si256();
+  }
+  __m256 u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_add_ps(cell[0], cell[1]), cell[2]),
+										 cell[3]), _mm256_set1_ps(G4));
+  for (int a=0; a<4; a++) {
+	c[a] = _mm256_cvttps_epi32(cell[a]);
+	d0[a] = _mm256_sub_ps(p[a], _mm256_sub_ps(cell[a], u));
+  }
+
+  const __m256i one = _mm256_set1_epi32(1);
+  for (int a=0; a<4; a++)
+	for (int b=a+1; b<4; b++) {
+	  __m256i ge = _mm256_castps_si256(_mm256_cmp_ps(d0[a], d0[b], _CMP_GE_OQ)); // -1 or 0
+	  rank[a] = _mm256_sub_epi32(rank[a], ge);
+	  rank[b] = _mm256_add_epi32(rank[b], _mm256_add_epi32(one, ge));
+	}
+
+  __m256 result = _mm256_setzero_ps();
+  for (int k=0; k<5; k++) {
+	__m256 d[4];
+	__m256i n = _mm256_setzero_si256();
+	for (int a=0; a<4; a++) {
+	  __m256i step = (k == 4) ? one
+		: _mm256_sub_epi32(_mm256_setzero_si256(),
+						   _mm256_cmpgt_epi32(rank[a], _mm256_set1_epi32(3-k)));
+	  d[a] = _mm256_add_ps(_mm256_sub_ps(d0[a], _mm256_cvtepi32_ps(step)), _mm256_set1_ps(k*G4));
+	  n = _mm256_add_epi32(n, _mm256_mullo_epi32(_mm256_add_epi32(c[a], step),
+												 _mm256_set1_epi32(stride[a])));
+	}
+	__m256 d2 = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(d[0], d[0]),
+															_mm256_mul_ps(d[1], d[1])),
+											  _mm256_mul_ps(d[2], d[2])),
+								_mm256_mul_ps(d[3], d[3]));
+	__m256 w = _mm256_sub_ps(_mm256_set1_ps(0.6f), d2);
+	__m256 inside = _mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_GT_OQ);
+	w = _mm256_mul_ps(w, w);
+	__m256 contribution = _mm256_mul_ps(_mm256_mul_ps(w, w), gradientDotAVX2(latticeBitsAVX2(n), d));
+	result = _mm256_add_ps(result, _mm256_and_ps(inside, contribution));
+  }
+  return _mm256_mul_ps(_mm256_set1_ps(27.f), result);
+}
+
+template <class Interpolation>
+NOISE_AVX2
+static unsigned int perlinNoiseAVX2(Perlin::Basis basis, int octave, float persistence,
+									float f0, float finalAmplitude,
+									const float *x, const float *y, const float *z, float t,
+									float *result, unsigned int count) {
+  unsigned int j;
+
+  for (j = 0; j + 8 <= count; j += 8) {
+	__m256 px = _mm256_loadu_ps(x + j), py = _mm256_loadu_ps(y + j), pz = _mm256_loadu_ps(z + j);
+	__m256 total = _mm256_setzero_ps();
+	float frequency = f0, amplitude = 1.f;
+
+	for (int i=0; i<=octave; i++) {
+	  __m256 vf = _mm256_set1_ps(frequency);
+	  __m256 fx = _mm256_mul_ps(px, vf), fy = _mm256_mul_ps(py, vf), fz = _mm256_mul_ps(pz, vf);
+	  __m256 n = (basis == Perlin::Simplex) ? simplexNoiseAVX2(fx, fy, fz, t*frequency)
+		: interpolatedNoiseAVX2<Interpolation>(fx, fy, fz, t*frequency);
+	  total = _mm256_add_ps(total, _mm256_mul_ps(n, _mm256_set1_ps(amplitude)));
+	  frequency *= 2.f;
+	  amplitude *= persistence;
+	}
+
+	if (finalAmplitude == 1.f)
+	  total = _mm256_div_ps(total, _mm256_set1_ps(octave+1));
+	else
+	  total = _mm256_div_ps(_mm256_mul_ps(total, _mm256_set1_ps(1.f-persistence)),
+							_mm256_set1_ps(1.f-finalAmplitude));
+	_mm256_storeu_ps(result + j, total);
+  }
+  return j;
+}
+#endif
+
+template <class Interpolation>
+void Perlin::perlinNoise(const float *x, const float *y, const float *z, float t,
+						 float *result, unsigned int count) const {
+  unsigned int i = 0;
+#if NOISE_SIMD
+  if (hasAVX2())
+	i = perlinNoiseAVX2<Interpolation>(basis, octave, persistence, f0, finalAmplitude(),
+									   x, y, z, t, result, count);
+#endif
+  for (; i < count; i++)
+	result[i] = perlinNoise<Interpolation>(x[i], y[i], z[i], t);
+}
+
+template void Perlin::perlinNoise<CosineInterpolation>(const float *, const float *, const float *,
+														float, float *, unsigned int) const;
+template void Perlin::perlinNoise<CubicInterpolation>(const float *, const float *, const float *,
+													   float, float *, unsigned int) const;
+template void Perlin::perlinNoise<QuinticInterpolation>(const float *, const float *, const float *,
+														 float, float *, unsigned int) const;
+template void Perlin::perlinNoise<TableCosineInterpolation>(const float *, const float *,
+															 const float *, float, float *,
+															 unsigned int) const;
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <cmath>
+#include <stdint.h>
+
+#include "Noise.h"
+#include "Interpolation.h"
+
+/*
+CPU port of the 4D noise of shaderPerlin.frag: the same Noise4 lattice hash
+(32 bit wraparound included), the same cosine interpolation and the same
+octave/persistence/f0 sum, so bakes can be compared with the shader output.
+
+Each octave uses one of two bases, as selected by the shader's basis
+uniform: the original value noise (16 hashed corners, 15 cosine
+interpolations) or simplex noise (5 corners, polynomial falloff).
+
+The value noise is templated on an interpolation policy (Interpolation.h);
+the plain entry points use CosineInterpolation, like the shader.
+*/
+class Perlin: public Noise {
+  public:
+    typedef enum {Value=0, Simplex=1} Basis;
+
+    int octave; // octaves 0..octave are summed, as in the shader
+    float persistence;
+    float f0;
+    Basis basis;
+
+    Perlin(int octave=4, float persistence=0.5f, float f0=1.f, Basis basis=Value)
+      : octave(octave), persistence(persistence), f0(f0), basis(basis) {
+    }
+
+    /* Noise4 strides: 57, 57^2, 57^3, 57^4 */
+    enum { StrideX = 57, StrideY = 3249, StrideZ = 185193, StrideT = 10556001 };
+
+    /* The integer part of Noise4 for the lattice index n = x*StrideX + ...
+       The shader relies on 32 bit int wraparound; unsigned arithmetic gives
+       the same bits without the undefined behaviour. */
+    static uint32_t latticeBits(uint32_t n) {
+      n = (n<<13) ^ n;
+      return (n * (n*n*15731u + 789221u) + 1376312589u) & 0x7fffffffu;
+    }
+
+    /* Noise4: value in [-1,1] at an integer lattice point */
+    static float lattice(int x, int y, int z, int t) {
+      uint32_t n = (uint32_t)x*StrideX + (uint32_t)y*StrideY
+        + (uint32_t)z*StrideZ + (uint32_t)t*StrideT;
+      return 1.f - (int)latticeBits(n) / 1073741824.f;
+    }
+
+    /* InterpolatedNoise3D: the slice of the 4D noise at integer time t.
+       The weight of each axis is computed once and reused by all the
+       blends along it. */
+    template <class Interpolation>
+    static float interpolatedNoise3D(float x, float y, float z, int t) {
+      int ix = floor(x), iy = floor(y), iz = floor(z);
+      float wx = Interpolation::weight(x-ix), wy = Interpolation::weight(y-iy);
+      float wz = Interpolation::weight(z-iz);
+      float v2[2];
+
+      for (int dz=0; dz<2; dz++) {
+        float i1 = blend(lattice(ix, iy, iz+dz, t), lattice(ix+1, iy, iz+dz, t), wx);
+        float i2 = blend(lattice(ix, iy+1, iz+dz, t), lattice(ix+1, iy+1, iz+dz, t), wx);
+        v2[dz] = blend(i1, i2, wy);
+      }
+      return blend(v2[0], v2[1], wz);
+    }
+
+    /* InterpolatedNoise4D: a blend of the slices at floor(t) and floor(t)+1 */
+    template <class Interpolation>
+    static float interpolatedNoise(float x, float y, float z, float t) {
+      int it = floor(t);
+      return blend(interpolatedNoise3D<Interpolation>(x, y, z, it),
+                   interpolatedNoise3D<Interpolation>(x, y, z, it+1),
+                   Interpolation::weight(t-it));
+    }
+
+    static float interpolatedNoise(float x, float y, float z, float t) {
+      return interpolatedNoise<CosineInterpolation>(x, y, z, t);
+    }
+
+    /* SimplexNoise4D: gradients picked by the Noise4 hash among the 32
+       edges of the tesseract, scaled to about [-1,1] */
+    static float simplexNoise(float x, float y, float z, float t);
+
+    /* PerlinNoise_4D */
+    template <class Interpolation>
+    float perlinNoise(float x, float y, float z, float t) const {
+      float frequency = f0, amplitude = 1.f, total = 0.f;
+
+      for (int i=0; i<=octave; i++) {
+        float fx = x*frequency, fy = y*frequency, fz = z*frequency, ft = t*frequency;
+        total += (basis == Simplex ? simplexNoise(fx, fy, fz, ft)
+                  : interpolatedNoise<Interpolation>(fx, fy, fz, ft)) * amplitude;
+        frequency *= 2.f;
+        amplitude *= persistence;
+      }
+
+      if (amplitude == 1.f) // persistence 1: the shader divides 0 by 0
+        return total / (octave+1);
+      return total * (1.f-persistence) / (1.f-amplitude);
+    }
+
+    float perlinNoise(float x, float y, float z, float t) const {
+      return perlinNoise<CosineInterpolation>(x, y, z, t);
+    }
+    float perlinNoise(const Vec3Df &p, float t) const {
+      return perlinNoise(p[0], p[1], p[2], t);
+    }
+
+    /* perlinNoise at (x[i], y[i], z[i], t) for i < count. With AVX2 eight
+       points run side by side with the policy's vector weight: the result
+       is the scalar one except for the cosine, whose polynomial stays
+       within 1e-6 of it after the octave sum. Instantiated for the four
+       policies of Interpolation.h. Single threaded; split big bakes across
+       threads (noisebake does). */
+    template <class Interpolation>
+    void perlinNoise(const float *x, const float *y, const float *z, float t,
+                     float *result, unsigned int count) const;
+
+    void perlinNoise(const float *x, const float *y, const float *z, float t,
+                     float *result, unsigned int count) const {
+      perlinNoise<CosineInterpolation>(x, y, z, t, result, count);
+    }
+
+    static float blend(float a, float b, float f) {
+      return a*(1-f) + b*f;
+    }
+
+  private:
+
+    /* amplitude after the last octave, p^(octave+1), computed like the shader */
+    float finalAmplitude() const;
+};
@@ -0,0 +1,166 @@
+#include <cmath>
+
+#include "PerlinSliceCache.h"
+#include "Parallel.h"
+using namespace std;
+
+PerlinSliceCache::PerlinSliceCache()
+  : stopping(false), generation(0), positions(new vector<Vec3Df>()), misses(0), prefetched(0) {
+  setPerlin(perlin.octave, perlin.persistence, perlin.f0);
+  worker = thread(&PerlinSliceCache::run, this);
+}
+
+PerlinSliceCache::~PerlinSliceCache() {
+  {
+	lock_guard<std::mutex> lock(mutex);
+	stopping = true;
+  }
+  wake.notify_all();
+  worker.join();
+}
+
+void PerlinSliceCache::setPositions(const vector<Vec3Df> &p) {
+  lock_guard<std::mutex> lock(mutex);
+  positions.reset(new vector<Vec3Df>(p));
+  reset();
+}
+
+void PerlinSliceCache::setPerlin(int octave, float persistence, float f0) {
+  lock_guard<std::mutex> lock(mutex);
+  if (!frequency.empty() && octave == perlin.octave && persistence == perlin.persistence
+	  && f0 == perlin.f0)
+	return;
+  perlin = Perlin(octave, persistence, f0, Perlin::Value);
+
+  /* the frequencies and amplitudes of Perlin::perlinNoise, same floats */
+  frequency.resize(octave+1);
+  amplitude.resize(octave+1);
+  float f = f0, a = 1.f;
+  for (int i=0; i<=octave; i++) {
+	frequency[i] = f;
+	amplitude[i] = a;
+	f *= 2.f;
+	a *= persistence;
+  }
+  reset();
+}
+
+/* mutex held */
+void PerlinSliceCache::reset() {
+  generation++;
+  slices.assign(frequency.size(), map<int, Slice>());
+  queue.clear();
+  misses = prefetched = 0;
+}
+
+/* mutex held */
+bool PerlinSliceCache::queued(unsigned int octave, int time) const {
+  for (unsigned int i=0; i<queue.size(); i++)
+	if (queue[i].octave == octave && queue[i].time == time)
+	  return true;
+  return false;
+}
+
+PerlinSliceCache::Slice PerlinSliceCache::computeSlice(const vector<Vec3Df> &p, float f,
+														int time, bool parallel) {
+  vector<float> *slice = new vector<float>(p.size());
+  auto compute = [&] (unsigned int begin, unsigned int end) {
+	for (unsigned int i=begin; i<end; i++)
+	  (*slice)[i] = Perlin::interpolatedNoise3D<CosineInterpolation>(p[i][0]*f, p[i][1]*f,
+																	   p[i][2]*f, time);
+  };
+  if (parallel)
+	parallelFor(p.size(), 4096, compute);
+  else
+	compute(0, p.size());
+  return Slice(slice);
+}
+
+const vector<float> &PerlinSliceCache::evaluate(float t) {
+  unsigned int octaves, gen;
+  Positions p;
+  vector<Slice> needed;
+  vector<int> time;
+  vector<float> weight, f, a;
+  float persistence;
+
+  {
+	lock_guard<std::mutex> lock(mutex);
+	octaves = frequency.size();
+	gen = generation;
+	p = positions;
+	f = frequency;
+	a = amplitude;
+	persistence = perlin.persistence;
+	needed.resize(2*octaves);
+	time.resize(octaves);
+	weight.resize(octaves);
+	for (unsigned int i=0; i<octaves; i++) {
+	  float ti = t*frequency[i];
+	  int k = floor(ti);
+	  time[i] = k;
+	  weight[i] = CosineInterpolation::weight(ti-k);
+
+	  map<int, Slice> &cached = slices[i];
+	  cached.erase(cached.begin(), cached.lower_bound(k));
+	  for (int d=0; d<2; d++) {
+		map<int, Slice>::iterator s = cached.find(k+d);
+		if (s != cached.end())
+		  needed[2*i+d] = s->second;
+	  }
+	  if (!cached.count(k+2) && !queued(i, k+2)) {
+		Request r = {i, k+2};
+		queue.push_back(r);
+	  }
+	}
+  }
+  wake.notify_one();
+
+  for (unsigned int i=0; i<2*octaves; i++)
+	if (!needed[i]) {
+	  needed[i] = computeSlice(*p, f[i/2], time[i/2] + i%2, true);
+	  lock_guard<std::mutex> lock(mutex);
+	  if (gen == generation) {
+		slices[i/2][time[i/2] + i%2] = needed[i];
+		misses++;
+	  }
+	}
+
+  /* Perlin::perlinNoise, with every InterpolatedNoise4D read from the slices */
+  result.resize(p->size());
+  float amplitudeEnd = a.empty() ? 1.f : a.back()*persistence;
+  for (unsigned int v=0; v<result.size(); v++) {
+	float total = 0.f;
+	for (unsigned int i=0; i<octaves; i++)
+	  total += Perlin::blend((*needed[2*i])[v], (*needed[2*i+1])[v], weight[i]) * a[i];
+	if (amplitudeEnd == 1.f)
+	  result[v] = total / octaves;
+	else
+	  result[v] = total * (1.f-persistence) / (1.f-amplitudeEnd);
+  }
+  return result;
+}
+
+void PerlinSliceCache::run() {
+  unique_lock<std::mutex> lock(mutex);
+  for (;;) {
+	wake.wait(lock, [this] () { return stopping || !queue.empty(); });
+	if (stopping)
+	  return;
+	Request r = queue.front();
+	queue.pop_front();
+	if (r.octave >= slices.size() || slices[r.octave].count(r.time))
+	  continue;
+
+	unsigned int gen = generation;
+	Positions p = positions;
+	float f = frequency[r.octave];
+	lock.unlock();
+	Slice slice = computeSlice(*p, f, r.time, false);
+	lock.lock();
+	if (gen == generation && !slices[r.octave].count(r.time)) {
+	  slices[r.octave][r.time] = slice;
+	  prefetched++;
+	}
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Perlin.h"
+#include "Vec3D.h"
+
+/*
+Per-position cache of the animated Perlin noise. Octave i of
+InterpolatedNoise4D only blends the two 3D slices at floor(t*f_i) and
+floor(t*f_i)+1, so the cache keeps those slices for a fixed set of positions
+(mesh vertices, texels) and a frame costs one blend per octave per position.
+
+When an octave starts using slice k, slice k+2 is queued on a background
+thread so it is ready when t reaches the next integer. Slices still missing
+(first frame, jumps in t, new parameters) are computed on the spot, on all
+cores. Value basis with cosine interpolation, like the shader: the result is
+Perlin::perlinNoise at the positions, bit for bit.
+*/
+class PerlinSliceCache {
+  public:
+    PerlinSliceCache();
+    ~PerlinSliceCache();
+
+    /* Both drop every cached slice */
+    void setPositions(const std::vector<Vec3Df> &positions);
+    void setPerlin(int octave, float persistence, float f0);
+
+    /* Noise at every position for time t */
+    const std::vector<float> &evaluate(float t);
+
+    /* Slices computed on the spot / ahead of time since the last reset */
+    unsigned int getMisses() const { return misses; }
+    unsigned int getPrefetched() const { return prefetched; }
+
+  private:
+    typedef std::shared_ptr<const std::vector<float> > Slice;
+    typedef std::shared_ptr<const std::vector<Vec3Df> > Positions;
+
+    struct Request {
+      unsigned int octave;
+      int time;
+    };
+
+    PerlinSliceCache(const PerlinSliceCache &);
+    PerlinSliceCache &operator= (const PerlinSliceCache &);
+
+    static Slice computeSlice(const std::vector<Vec3Df> &positions, float frequency,
+                              int time, bool parallel);
+    void reset();
+    bool queued(unsigned int octave, int time) const;
+    void run();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::thread worker;
+    bool stopping;
+    unsigned int generation; // bumped by reset(), stale work is dropped
+
+    Positions positions;
+    Perlin perlin;
+    std::vector<float> frequency, amplitude;
+    std::vector<std::map<int, Slice> > slices; // per octave, by integer time
+    std::deque<Request> queue;
+    std::vector<float> result;
+    unsigned int misses, prefetched;
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <cmath>
+#include <stdint.h>
+
+/*
+Counter-based random numbers: every value is a pure function of
+(seed, index), so any tile cell can be drawn on any thread, in any order,
+and reproduced exactly. The mixer is the SplitMix64 finalizer.
+*/
+class Random {
+  public:
+    static uint64_t mix(uint64_t z) {
+      z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+      z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+      return z ^ (z >> 31);
+    }
+
+    static uint64_t hash(uint64_t seed, uint64_t index) {
+      return mix(mix(seed) + (index+1) * 0x9E3779B97F4A7C15ull);
+    }
+
+    static float uniform01(uint64_t seed, uint64_t index) { //[0,1)
+      return (hash(seed, index) >> 40) * (1.f/16777216.f);
+    }
+
+    static float uniform(uint64_t seed, uint64_t index) { //[-1,1)
+      return 2.f*uniform01(seed, index) - 1.f;
+    }
+
+    /* Box-Muller on the two halves of one hash; mean = 0, var = 1 */
+    static float gaussian(uint64_t seed, uint64_t index) {
+      uint64_t h = hash(seed, index);
+      double u1 = ((h >> 32) + 1.0) * (1.0/4294967296.0); // (0,1]
+      double u2 = (h & 0xFFFFFFFFull) * (1.0/4294967296.0);
+      return sqrt(-2.0*log(u1)) * cos(2.0*M_PI*u2);
+    }
+};
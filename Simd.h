@@ -0,0 +1,37 @@
+#pragma once
+
+/*
+SIMD kernels are compiled per function with GCC target attributes and picked
+at runtime, so the default build (no -march flag) still runs everywhere.
+*/
+
+/* The widest kernels the dispatch may pick: lowered, a CPU runs its other
+   paths too, which bench_noise -check compares */
+enum SimdLevel { SimdNone, SimdAVX2, SimdAVX512 };
+
+inline SimdLevel &simdLimit() {
+  static SimdLevel limit = SimdAVX512;
+  return limit;
+}
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define NOISE_SIMD 1
+#include <immintrin.h>
+
+/* AVX-512F implies FMA for GCC; keep mul+add separate so the kernels round
+   exactly like the scalar code. */
+#define NOISE_AVX2 __attribute__((target("avx2")))
+#define NOISE_AVX512 __attribute__((target("avx512f"), optimize("fp-contract=off")))
+
+inline bool hasAVX2() {
+  static const bool avx2 = __builtin_cpu_supports("avx2");
+  return avx2 && simdLimit() >= SimdAVX2;
+}
+
+inline bool hasAVX512() {
+  static const bool avx512 = __builtin_cpu_supports("avx512f");
+  return avx512 && simdLimit() >= SimdAVX512;
+}
+#else
+#define NOISE_SIMD 0
+#endif
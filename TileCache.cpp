@@ -0,0 +1,149 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "TileCache.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char tileMagic[8] = {'W','N','T','I','L','E',0,0};
+static const uint32_t tileVersion = 1;
+
+static_assert(sizeof(TileFileHeader) == 64, "tile data must stay 64-byte aligned");
+
+string TileCache::path(const string &directory, int tileSize, float clamp,
+                       unsigned int seed) {
+  /* the clamp goes in as raw bits so nearby values never share a file */
+  uint32_t clampBits;
+  memcpy(&clampBits, &clamp, sizeof(clampBits));
+  char name[96];
+  snprintf(name, sizeof(name), "wavelet-v%u-n%d-c%08x-s%u.tile",
+           tileVersion, tileSize, clampBits, seed);
+  return directory + "/" + name;
+}
+
+/* FNV-1a over 64-bit words: fast enough to run on every load */
+uint64_t TileCache::checksum(const float *data, size_t count) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+  size_t size = count*sizeof(float), i;
+  uint64_t h = 0xCBF29CE484222325ull, word;
+  for (i = 0; i + 8 <= size; i += 8) {
+    memcpy(&word, bytes+i, 8);
+    h = (h ^ word) * 0x100000001B3ull;
+  }
+  for (; i < size; i++)
+    h = (h ^ bytes[i]) * 0x100000001B3ull;
+  return h;
+}
+
+#ifndef _WIN32
+
+const float *TileCache::map(const string &path, int tileSize, float clamp,
+                            unsigned int seed, void **mapping, size_t *mappingSize) {
+  const size_t count = (size_t)tileSize*tileSize*tileSize;
+  const size_t size = sizeof(TileFileHeader) + count*sizeof(float);
+
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (size_t)st.st_size != size) {
+    close(fd);
+    return NULL;
+  }
+  void *base = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  const TileFileHeader *header = static_cast<const TileFileHeader *>(base);
+  const float *data = reinterpret_cast<const float *>(
+    static_cast<const char *>(base) + sizeof(TileFileHeader));
+  if (memcmp(header->magic, tileMagic, sizeof(tileMagic)) ||
+      header->version != tileVersion ||
+      header->tileSize != (uint32_t)tileSize ||
+      memcmp(&header->clamp, &clamp, sizeof(clamp)) ||
+      header->seed != seed ||
+      header->dataOffset != sizeof(TileFileHeader) ||
+      header->checksum != checksum(data, count)) {
+    munmap(base, size);
+    return NULL;
+  }
+
+  *mapping = base;
+  *mappingSize = size;
+  return data;
+}
+
+void TileCache::unmap(void *mapping, size_t mappingSize) {
+  munmap(mapping, mappingSize);
+}
+
+static bool writeAll(int fd, const void *buffer, size_t size) {
+  const char *p = static_cast<const char *>(buffer);
+  while (size) {
+    ssize_t written = ::write(fd, p, size);
+    if (written <= 0)
+      return false;
+    p += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool TileCache::write(const string &path, int tileSize, float clamp,
+                      unsigned int seed, const float *data) {
+  const size_t count = (size_t)tileSize*tileSize*tileSize;
+
+  TileFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, tileMagic, sizeof(tileMagic));
+  header.version = tileVersion;
+  header.tileSize = tileSize;
+  header.clamp = clamp;
+  header.seed = seed;
+  header.checksum = checksum(data, count);
+  header.dataOffset = sizeof(TileFileHeader);
+
+  /* a file of its own for each writer, threads of one process included */
+  string tmp = path + ".tmp.XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd == -1)
+    return false;
+  if (fchmod(fd, 0644) != 0) {
+    close(fd);
+    unlink(tmp.c_str());
+    return false;
+  }
+  bool ok = writeAll(fd, &header, sizeof(header)) &&
+            writeAll(fd, data, count*sizeof(float)) &&
+            fsync(fd) == 0;
+  ok = (close(fd) == 0) && ok;
+  /* rename() replaces atomically; a concurrent writer produced the same bytes */
+  if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+    unlink(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+#else
+
+const float *TileCache::map(const string &, int, float, unsigned int, void **, size_t *) {
+  return NULL;
+}
+
+void TileCache::unmap(void *, size_t) {}
+
+bool TileCache::write(const string &, int, float, unsigned int, const float *) {
+  return false;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <string>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+On-disk wavelet noise tiles, shared between processes through the page cache.
+
+File layout: a 64-byte TileFileHeader followed by n^3 floats, so the data is
+64-byte aligned once the file is mapped. Files are written under a unique
+temporary name and renamed into place, so readers never see a partial tile.
+*/
+
+struct TileFileHeader {
+  char magic[8];         // "WNTILE\0\0"
+  uint32_t version;
+  uint32_t tileSize;     // n, the data holds n^3 floats
+  float clamp;
+  uint32_t seed;
+  uint64_t checksum;     // of the float data, see TileCache::checksum
+  uint64_t dataOffset;   // always sizeof(TileFileHeader)
+  char reserved[24];
+};
+
+class TileCache {
+  public:
+    /* Where a (tileSize, clamp, seed) tile lives inside directory */
+    static std::string path(const std::string &directory, int tileSize,
+                            float clamp, unsigned int seed);
+
+    /* Maps the tile read-only. Returns the tile data, or NULL when the file
+       is missing or does not match the parameters or its checksum. */
+    static const float *map(const std::string &path, int tileSize, float clamp,
+                            unsigned int seed, void **mapping, size_t *mappingSize);
+    static void unmap(void *mapping, size_t mappingSize);
+
+    /* Writes the tile atomically; returns false on any I/O error */
+    static bool write(const std::string &path, int tileSize, float clamp,
+                      unsigned int seed, const float *data);
+
+    static uint64_t checksum(const float *data, size_t count);
+};
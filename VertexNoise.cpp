@@ -0,0 +1,83 @@
+#include "VertexNoise.h"
+#include "Parallel.h"
+using namespace std;
+
+/* noiseData in shaderWavelet.frag */
+static const int shaderTileSize = 4;
+static const float shaderTile[4*4*4] = {
+  0.196901,0.226127,0.73559,-0.19617,0.232854,0.542263,-0.326628,0.115312,
+  0.382126,-0.251225,-0.194003,-0.139241,0.0292745,-0.286176,-0.340949,0.322836,
+  0.00314856,0.0181928,-0.410858,-0.364563,-0.415781,0.184471,0.668723,-0.21028,
+  0.417364,-0.0364163,-0.0772177,-0.200269,-0.552198,0.202988,-0.00685827,0.378057,
+  -0.222047,-0.628905,0.414194,0.379778,0.0611332,-0.288577,0.417755,-0.48197,
+  0.0599536,0.6066,-0.487573,-0.191867,-0.168617,0.0132412,0.30492,-0.131832,
+  -0.509103,-0.0795462,-0.137075,0.57419,0.287148,0.417486,-0.319362,0.593332,
+  -0.460702,-0.130681,0.27446,0.428837,-0.391115,-0.205771,-0.170539,-0.475143
+};
+
+/* the P*100 of shaderWavelet.frag and P*1000 of shaderGabor.frag */
+static const float waveletScale = 100.f;
+static const float gaborScale = 1000.f;
+
+void VertexNoise::setShaderTile(Wavelet &wavelet) {
+  wavelet.setNoiseTile(shaderTileSize, shaderTile);
+}
+
+void VertexNoise::setMesh(const vector<Vec3Df> &positions, const vector<Vec3Df> &normals) {
+  unsigned int n = positions.size();
+  x.resize(n); y.resize(n); z.resize(n);
+  nx.resize(n); ny.resize(n); nz.resize(n);
+  for (unsigned int i=0; i<n; i++) {
+	x[i] = positions[i][0]; y[i] = positions[i][1]; z[i] = positions[i][2];
+	nx[i] = normals[i][0]; ny[i] = normals[i][1]; nz[i] = normals[i][2];
+  }
+  result.resize(n);
+}
+
+const vector<float> &VertexNoise::perlin(const Perlin &perlin, float t) {
+  parallelFor(size(), 16*Block, [&] (unsigned int begin, unsigned int end) {
+	perlin.perlinNoise(&x[begin], &y[begin], &z[begin], t, &result[begin], end-begin);
+  });
+  return result;
+}
+
+const vector<float> &VertexNoise::wavelet(Wavelet &wavelet, const Wavelet::BandPlan &plan) {
+  parallelFor(size(), 16*Block, [&] (unsigned int begin, unsigned int end) {
+	float px[Block], py[Block], pz[Block];
+	for (unsigned int i=begin; i<end; i+=Block) {
+	  unsigned int count = min(end-i, (unsigned int)Block);
+	  for (unsigned int j=0; j<count; j++) {
+		px[j] = x[i+j]*waveletScale;
+		py[j] = y[i+j]*waveletScale;
+		pz[j] = z[i+j]*waveletScale;
+	  }
+	  if (plan.projected)
+		wavelet.multibandNoise(plan, px, py, pz, &nx[i], &ny[i], &nz[i], &result[i], count);
+	  else
+		wavelet.multibandNoise(plan, px, py, pz, &result[i], count);
+	}
+  });
+  return result;
+}
+
+const vector<float> &VertexNoise::gabor(const Gabor &gabor, bool solid) {
+  const float scale = 3.f * sqrt(solid ? gabor.variance3D() : gabor.variance());
+  parallelFor(size(), 16*Block, [&] (unsigned int begin, unsigned int end) {
+	float px[Block], py[Block], pz[Block];
+	for (unsigned int i=begin; i<end; i+=Block) {
+	  unsigned int count = min(end-i, (unsigned int)Block);
+	  for (unsigned int j=0; j<count; j++) {
+		px[j] = x[i+j]*gaborScale;
+		py[j] = y[i+j]*gaborScale;
+		pz[j] = z[i+j]*gaborScale;
+	  }
+	  if (solid)
+		gabor.gaborNoise(px, py, pz, &result[i], count);
+	  else
+		gabor.gaborNoise(px, py, &result[i], count);
+	  for (unsigned int j=0; j<count; j++)
+		result[i+j] = 0.5f + 0.5f * result[i+j] / scale;
+	}
+  });
+  return result;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "Gabor.h"
+#include "Noise.h"
+#include "Perlin.h"
+#include "Vec3D.h"
+
+/*
+The noises of the fragment shaders evaluated once per mesh vertex, for
+gmini's per-vertex mode: shaderVertexNoise then only interpolates the values
+across the triangles. Positions and normals are kept as structure-of-arrays
+and the batch kernels run over them on all cores. Each noise reads the
+positions the way its fragment shader reads P (and N).
+*/
+class VertexNoise {
+  public:
+    enum { Block = 256 };
+
+    void setMesh(const std::vector<Vec3Df> &positions, const std::vector<Vec3Df> &normals);
+    unsigned int size() const { return x.size(); }
+
+    /* shaderPerlin.frag: PerlinNoise_4D(P, t), value or simplex basis */
+    const std::vector<float> &perlin(const Perlin &perlin, float t);
+
+    /* shaderWavelet.frag: multibandNoise(100 P[, N]) */
+    const std::vector<float> &wavelet(Wavelet &wavelet, const Wavelet::BandPlan &plan);
+
+    /* shaderGabor.frag: 0.5 + 0.5 GaborNoise(1000 P.xy) / (3 sqrt(variance)),
+       or GaborNoise3D(1000 P.xyz) and variance3D when solid */
+    const std::vector<float> &gabor(const Gabor &gabor, bool solid=false);
+
+    /* The 4^3 tile hard-coded in shaderWavelet.frag (noiseData) */
+    static void setShaderTile(Wavelet &wavelet);
+
+  private:
+    std::vector<float> x, y, z, nx, ny, nz;
+    std::vector<float> result;
+};
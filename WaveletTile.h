@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "Noise.h"
+
+/*
+A copy of a Wavelet noise tile whose size N is a compile-time power of two,
+so coordinates wrap with a bitmask instead of Wavelet::mod.
+
+With Pad > 0 the tile is stored with Pad ghost cells on every side, copied
+from the opposite faces: once the cell under p is wrapped, every tap within
+Pad cells of it is read directly. Pad >= 1 covers the 3x3x3 gather of wNoise,
+Pad >= 4 the whole bounding box of wProjectedNoise.
+
+Tiles of any other size keep using Wavelet itself.
+*/
+template <int N, int Pad = 0>
+class WaveletTile {
+  static_assert(N >= 2 && (N & (N-1)) == 0, "tile size must be a power of two");
+
+  public:
+    enum { Size = N, Mask = N-1, Stride = N+2*Pad };
+
+    /* Throws std::invalid_argument when the wavelet's tile isn't N wide,
+       std::bad_alloc when the copy can't be allocated */
+    explicit WaveletTile(const Wavelet &wavelet) {
+      if (wavelet.getNoiseTileSize() != N)
+        throw std::invalid_argument("WaveletTile<" + std::to_string(N) + ">: the wavelet tile is "
+                                    + std::to_string(wavelet.getNoiseTileSize()) + " wide");
+      size_t size = (size_t)Stride*Stride*Stride*sizeof(float);
+      data = static_cast<float *>(aligned_alloc(64, (size+63)/64*64));
+      if (!data)
+        throw std::bad_alloc();
+      for (int z=0; z<Stride; z++)
+        for (int y=0; y<Stride; y++)
+          for (int x=0; x<Stride; x++)
+            data[(z*Stride+y)*Stride+x] = wavelet.noiseTileData[
+              (((z-Pad)&Mask)*N + ((y-Pad)&Mask))*N + ((x-Pad)&Mask)];
+    }
+
+    ~WaveletTile() {
+      free(data);
+    }
+
+    float at(int x, int y, int z) const {
+      return data[(((z&Mask)+Pad)*Stride + (y&Mask)+Pad)*Stride + (x&Mask)+Pad];
+    }
+
+    /* Same arithmetic as Wavelet::wNoise, hence the same floats */
+    float wNoise(const Vec3Df &p) const {
+      int i, mid[3];
+      float w[3][3], t, result = 0;
+
+      for (i=0; i<3; i++) {
+        mid[i]=ceil(p[i]-0.5); t=mid[i]-(p[i]-0.5);
+        w[i][0]=t*t/2; w[i][2]=(1-t)*(1-t)/2; w[i][1]=1-w[i][0]-w[i][2];
+      }
+
+      if (Pad >= 1) {
+        /* one wrap per axis, then the 27 taps are plain offsets */
+        const float *center = &data[(((mid[2]&Mask)+Pad)*Stride + (mid[1]&Mask)+Pad)*Stride
+                                    + (mid[0]&Mask)+Pad];
+        for (int f2=-1; f2<=1; f2++)
+          for (int f1=-1; f1<=1; f1++)
+            for (int f0=-1; f0<=1; f0++) {
+              float weight = w[0][f0+1]*w[1][f1+1]*w[2][f2+1];
+              result += weight * center[(f2*Stride+f1)*Stride+f0];
+            }
+      } else {
+        for (int f2=-1; f2<=1; f2++)
+          for (int f1=-1; f1<=1; f1++)
+            for (int f0=-1; f0<=1; f0++) {
+              float weight = w[0][f0+1]*w[1][f1+1]*w[2][f2+1];
+              result += weight * data[(((mid[2]+f2)&Mask)*N + ((mid[1]+f1)&Mask))*N
+                                      + ((mid[0]+f0)&Mask)];
+            }
+      }
+      return result;
+    }
+
+    void wNoise(const float *x, const float *y, const float *z,
+                float *result, unsigned int count) const {
+      for (unsigned int j=0; j<count; j++)
+        result[j] = wNoise(Vec3Df(x[j], y[j], z[j]));
+    }
+
+    /* Same evaluator as the scalar Wavelet::wProjectedNoise, each row summed
+       before it is added, hence the same floats */
+    float wProjectedNoise(const Vec3Df &p, const Vec3Df &normal) const {
+      int i, c[3], min[3], max[3];
+      float A[3], h[3], slope[3], result = 0;
+
+      Wavelet::projectedSetup(p, normal, min, max, A, h, slope);
+
+      for (c[2]=min[2]; c[2]<=max[2]; c[2]++)
+        for (c[1]=min[1]; c[1]<=max[1]; c[1]++) {
+          float base[3], lo = min[0], hi = max[0];
+          float nc = normal[1]*c[1] + normal[2]*c[2];
+          for (i=0; i<3; i++)
+            base[i] = A[i] - h[i]*nc;
+          base[1] += c[1];
+          base[2] += c[2];
+          if (!Wavelet::clipSupport(base, slope, lo, hi))
+            continue;
+
+          int c0lo = ceil(lo), c0hi = floor(hi);
+          float sum = 0;
+          if (Pad >= 4) {
+            /* the box spans at most 4 cells around floor(p), so c0 read
+               from the wrapped cell under it never leaves the padding */
+            int anchor = (int)floor(p[0]);
+            const float *row = &data[(((c[2]&Mask)+Pad)*Stride + (c[1]&Mask)+Pad)*Stride
+                                     + (anchor&Mask)+Pad];
+            for (int c0=c0lo; c0<=c0hi; c0++)
+              sum += weight(base, slope, c0) * row[c0 - anchor];
+          } else {
+            const float *row = &data[(((c[2]&Mask)+Pad)*Stride + (c[1]&Mask)+Pad)*Stride + Pad];
+            for (int c0=c0lo; c0<=c0hi; c0++)
+              sum += weight(base, slope, c0) * row[c0&Mask];
+          }
+          result += sum;
+        }
+      return result;
+    }
+
+    float multibandNoise(const Wavelet::BandPlan &plan, const Vec3Df &p) const {
+      float result=0;
+      for (unsigned int b=0; b<plan.scale.size(); b++)
+        result += plan.weight[b] * wNoise(p*plan.scale[b]);
+      return result / plan.normalization;
+    }
+
+    float multibandNoise(const Wavelet::BandPlan &plan, const Vec3Df &p,
+                         const Vec3Df &normal) const {
+      float result=0;
+      for (unsigned int b=0; b<plan.scale.size(); b++)
+        result += plan.weight[b] * wProjectedNoise(p*plan.scale[b], normal);
+      return result / plan.normalization;
+    }
+
+  private:
+    WaveletTile(const WaveletTile &);
+    WaveletTile &operator= (const WaveletTile &);
+
+    static float weight(const float *base, const float *slope, int c0) {
+      return Wavelet::bspline(base[0]+slope[0]*c0) *
+             Wavelet::bspline(base[1]+slope[1]*c0) *
+             Wavelet::bspline(base[2]+slope[2]*c0);
+    }
+
+    float *data;
+};
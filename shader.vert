@@ -20,13 +20,19 @@
 //                                                                          
 // --------------------------------------------------------------------------
 
+// (1,0,0), (0,1,0), (0,0,1) at the corners of each triangle, for the
+// wireframe of the solid mode
+attribute vec3 barycentricCoords;
+
 varying vec4 P;
 varying vec3 N;
+varying vec3 barycentric;
 
 void main(void)
 {
     P = gl_Vertex;
     N = gl_Normal;
+    barycentric = barycentricCoords;
     
     gl_Position = ftransform ();
     gl_FrontColor = gl_Color;
@@ -33,6 +33,8 @@ uint seed_kernel;
 uniform float diffuseRef;
 uniform float specRef;
 uniform float shininess;
+uniform bool wireframe;
+varying vec3 barycentric;
 
 // gabor kernel properties
 uniform float K;
@@ -40,10 +42,25 @@ uniform float omega_0;
 uniform float a;
 uniform bool iso;
 
+// impulses read from a table built on the CPU (Gabor::impulseAtlas) instead
+// of drawn for each fragment; the noise repeats every atlasPeriod cells
+uniform bool impulseAtlas;
+uniform sampler2D atlas;
+uniform int atlasPeriod;
+uniform int atlasSlots;
+
+// a fixed jittered grid of impulses per cell (Gabor::stratified): the same
+// work for every fragment
+uniform bool stratified;
+
+// solid noise over P.xyz (Gabor::gaborNoise(x, y, z)) instead of P.xy
+uniform bool solid;
+
 float F_0 = 0.0625;
 float number_of_impulses_per_kernel = 64.0;
 float radius = sqrt(-log(0.05) / 3.14159265) / a;
 float impulseDensity = number_of_impulses_per_kernel / (3.14159265 * radius * radius);
+float impulseDensity3D = number_of_impulses_per_kernel / ((4.0 / 3.0) * 3.14159265 * radius * radius * radius);
 
 int MAX_RAND = (((1<<30) -1)<<1)+1;
 
@@ -133,6 +150,64 @@ float cell(int i, int j, float x, float y)
   return noise;
 }
 
+float atlasCell(int i, int j, float x, float y)
+{
+  int ci = i % atlasPeriod;
+  int cj = j % atlasPeriod;
+  ci += (ci < 0) ? atlasPeriod : 0;
+  cj += (cj < 0) ? atlasPeriod : 0;
+
+  // the impulse count, then the impulses. Not a fixed atlasSlots-1 loop over
+  // zero weighted empty slots: the widest cell holds about twice the mean
+  // count, and neighbouring fragments mostly share cells, so the count rarely
+  // diverges within a group of fragments
+  int first = ci * atlasSlots;
+  int number_of_impulses = int(texelFetch2D(atlas, ivec2(first, cj), 0).x);
+  float noise = 0.0;
+  for (int k = 1; k <= number_of_impulses; ++k) {
+    vec4 impulse = texelFetch2D(atlas, ivec2(first + k, cj), 0);
+    float omega_0_i = iso ? impulse.w : omega_0;
+    float x_i_x = x - impulse.x;
+    float y_i_y = y - impulse.y;
+
+    if (((x_i_x * x_i_x) + (y_i_y * y_i_y)) < 1.0) {
+      noise = noise + impulse.z * gabor(omega_0_i, x_i_x*radius, y_i_y*radius);
+    }
+  }
+  return noise;
+}
+
+float stratifiedCell(int i, int j, float x, float y)
+{
+  uint seed_cell = morton(uint(i), uint(j));
+
+  if (seed_cell == uint(0)) {
+    seed_cell = uint(1);
+  }
+  seed(seed_cell);
+
+  float number_of_impulses_per_cell = impulseDensity * radius * radius;
+  int strata = max(1, int(sqrt(number_of_impulses_per_cell)));
+  float step = 1.0 / float(strata);
+
+  // the variance of the Poisson cells
+  float w_scale = sqrt(number_of_impulses_per_cell / float(strata * strata));
+
+  float noise = 0.0;
+  for (int k = 0; k < strata * strata; ++k) {
+    float x_i = (float(k % strata) + uniform_0_1()) * step;
+    float y_i = (float(k / strata) + uniform_0_1()) * step;
+    float w_i = unif(-1.0, +1.0) * w_scale;
+    float omega_0_i = iso ? unif(0.0, 2.0 * 3.14159265) : omega_0;
+    float x_i_x = x - x_i;
+    float y_i_y = y - y_i;
+
+    float inside = float(((x_i_x * x_i_x) + (y_i_y * y_i_y)) < 1.0);
+    noise = noise + inside * w_i * gabor(omega_0_i, x_i_x*radius, y_i_y*radius);
+  }
+  return noise;
+}
+
 float GaborNoise(float x, float y) {
     x /= radius; 
     y /= radius;
@@ -147,12 +222,119 @@ float GaborNoise(float x, float y) {
 
     for (int di = -1; di <= +1; ++di) {
       for (int dj = -1; dj <= +1; ++dj) {
-        noise += cell(int_x + di, int_y + dj, frac_x - di, frac_y - dj);
+        if (stratified)
+          noise += stratifiedCell(int_x + di, int_y + dj, frac_x - di, frac_y - dj);
+        else if (impulseAtlas)
+          noise += atlasCell(int_x + di, int_y + dj, frac_x - di, frac_y - dj);
+        else
+          noise += cell(int_x + di, int_y + dj, frac_x - di, frac_y - dj);
+      }
+    }
+    return noise;
+}
+
+
+///////////////////////////////////////////////
+///////
+///////           SOLID GABOR NOISE
+///////
+///////////////////////////////////////////////
+uint morton3(uint x, uint y, uint z)
+{
+  uint m = uint(0);
+  for (uint i = uint(0); i < uint(10); ++i) {
+    m |= (((x >> i) & uint(1)) << (uint(3) * i))
+       | (((y >> i) & uint(1)) << (uint(3) * i + uint(1)))
+       | (((z >> i) & uint(1)) << (uint(3) * i + uint(2)));
+  }
+  return m;
+}
+
+float gabor3(vec3 direction, vec3 x)
+{
+  float gaussian_envelop = K * exp(-3.14159265 * (a * a) * dot(x, x));
+  float sinusoidal_carrier = cos(2.0 * 3.14159265 * F_0 * dot(x, direction));
+  return gaussian_envelop * sinusoidal_carrier;
+}
+
+float cell3D(ivec3 c, vec3 x)
+{
+  uint seed_cell = morton3(uint(c.x), uint(c.y), uint(c.z));
+
+  if (seed_cell == uint(0)) {
+    seed_cell = uint(1);
+  }
+  seed(seed_cell);
+
+  float number_of_impulses_per_cell = impulseDensity3D * radius * radius * radius;
+  uint budget = uint(ceil(number_of_impulses_per_cell + 4.0 * sqrt(number_of_impulses_per_cell)));
+
+  // poisson(), stopped at the budget
+  float g_ = exp(-number_of_impulses_per_cell);
+  uint number_of_impulses = uint(0);
+  float t = uniform_0_1();
+  while (t > g_ && number_of_impulses < budget) {
+    ++number_of_impulses;
+    t *= uniform_0_1();
+  }
+
+  float noise = 0.0;
+  for (uint i = uint(0); i < number_of_impulses; ++i) {
+    vec3 x_i;
+    x_i.x = uniform_0_1();
+    x_i.y = uniform_0_1();
+    x_i.z = uniform_0_1();
+    float w_i = unif(-1.0, +1.0);
+    float omega_i = omega_0;
+    float cos_theta_i = 0.0;
+    if (iso) {
+      omega_i = unif(0.0, 2.0 * 3.14159265);
+      cos_theta_i = unif(-1.0, +1.0);
+    }
+    float sin_theta_i = sqrt(1.0 - cos_theta_i * cos_theta_i);
+    vec3 direction = vec3(sin_theta_i * cos(omega_i), sin_theta_i * sin(omega_i), cos_theta_i);
+    vec3 x_i_x = x - x_i;
+
+    if (dot(x_i_x, x_i_x) < 1.0) {
+      noise = noise + w_i * gabor3(direction, x_i_x * radius);
+    }
+  }
+  return noise;
+}
+
+float GaborNoise3D(vec3 x) {
+    x /= radius;
+
+    ivec3 int_x = ivec3(floor(x));
+    vec3 frac_x = x - vec3(int_x);
+
+    // squared distances to the neighbour cells along each axis: the cells
+    // out of the kernel radius are skipped
+    vec3 reach_low = frac_x * frac_x;
+    vec3 reach_high = (1.0 - frac_x) * (1.0 - frac_x);
+
+    float noise = 0.0;
+    for (int di = -1; di <= +1; ++di) {
+      float reach_i = (di < 0) ? reach_low.x : (di > 0) ? reach_high.x : 0.0;
+      for (int dj = -1; dj <= +1; ++dj) {
+        float reach_j = reach_i + ((dj < 0) ? reach_low.y : (dj > 0) ? reach_high.y : 0.0);
+        for (int dk = -1; dk <= +1; ++dk) {
+          float reach = reach_j + ((dk < 0) ? reach_low.z : (dk > 0) ? reach_high.z : 0.0);
+          if (reach < 1.0) {
+            ivec3 d = ivec3(di, dj, dk);
+            noise += cell3D(int_x + d, frac_x - vec3(d));
+          }
+        }
       }
     }
     return noise;
 }
 
+float variance3D()
+{
+  float integral_gabor_filter_squared = ((K * K) / (2.0 * pow(2.0 * a * a, 1.5))) * (1.0 + exp(-(2.0 * 3.14159265 * F_0 * F_0) / (a * a)));
+  return impulseDensity3D * (1.0 / 3.0) * integral_gabor_filter_squared;
+}
 
 float variance()
 {
@@ -167,8 +349,11 @@ void main(void) {
 
 
 	// GABOR NOISE
-	float scale = 3.0 * sqrt(variance());
-	float noise_gabor = 0.5 + 0.5 * GaborNoise(P.x*1000.0, P.y*1000.0)/scale;
+	float noise_gabor;
+	if (solid)
+		noise_gabor = 0.5 + 0.5 * GaborNoise3D(P.xyz*1000.0)/(3.0 * sqrt(variance3D()));
+	else
+		noise_gabor = 0.5 + 0.5 * GaborNoise(P.x*1000.0, P.y*1000.0)/(3.0 * sqrt(variance()));
 	gl_FragColor.rgb += noise_gabor;
 
 
@@ -189,6 +374,12 @@ void main(void) {
 
 	gl_FragColor += vec4(LightContribution.xyz, 1);
 
+	// solid mode: the triangle edges in black, where a barycentric
+	// coordinate gets within a pixel of 0
+	if (wireframe) {
+		vec3 edge = smoothstep (vec3 (0.0), fwidth (barycentric), barycentric);
+		gl_FragColor.rgb *= min (min (edge.x, edge.y), edge.z);
+	}
 
 }
 
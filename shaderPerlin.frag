@@ -30,12 +30,15 @@ varying vec3 N;
 uniform float diffuseRef;
 uniform float specRef;
 uniform float shininess;
+uniform bool wireframe;
+varying vec3 barycentric;
 
 // perlin noise properties
 uniform int octave;
 uniform float persistence;
 uniform float f0;
 uniform float t;
+uniform int basis; // 0: value noise, 1: simplex noise
 
 ///////////////////////////////////////////////
 ///////
@@ -50,7 +53,7 @@ float Interpolate(float a, float b, float x)
   return  a * (1.0-f) + b*f;
 }
 
-float Noise4(int x, int y, int z, int t)
+int Hash4(int x, int y, int z, int t)
 {
 
 	int c = 57;
@@ -63,7 +66,12 @@ float Noise4(int x, int y, int z, int t)
 	n += c*t;
 
 	n = (n<<13) ^ n;
-	return 1.0 - ( (n * (n * n * 15731 + 789221) + 1376312589) & 0x7fffffff) / 1073741824.0;
+	return (n * (n * n * 15731 + 789221) + 1376312589) & 0x7fffffff;
+}
+
+float Noise4(int x, int y, int z, int t)
+{
+	return 1.0 - Hash4(x, y, z, t) / 1073741824.0;
 }
 
 float InterpolatedNoise2D(float x, float y, int z, int t)
@@ -108,6 +116,67 @@ float InterpolatedNoise4D(float x, float y, float z, float t)
 	return Interpolate(v1, v2, fractional_T);
 }
 
+///////////////////////////////////////////////
+///////
+///////           SIMPLEX NOISE
+///////
+///////////////////////////////////////////////
+// 5 corners instead of 16 and a polynomial falloff instead of cos().
+// Gradients are the 32 edges of the tesseract, picked by Hash4 bits 8..12:
+// bits 3-4 give the zero axis, bits 0-2 the signs of the others.
+float SimplexCorner(ivec4 c, vec4 d)
+{
+	float w = 0.6 - dot(d, d);
+	if (w <= 0.0)
+		return 0.0;
+
+	int h = (Hash4(c.x, c.y, c.z, c.w) >> 8) & 31;
+	int zero = h >> 3;
+	vec3 s = vec3((h & 1) != 0 ? -1.0 : 1.0,
+				  (h & 2) != 0 ? -1.0 : 1.0,
+				  (h & 4) != 0 ? -1.0 : 1.0);
+	vec4 g = zero == 0 ? vec4(0.0, s) :
+		zero == 1 ? vec4(s.x, 0.0, s.yz) :
+		zero == 2 ? vec4(s.xy, 0.0, s.z) : vec4(s, 0.0);
+
+	w *= w;
+	return w * w * dot(g, d);
+}
+
+float SimplexNoise4D(float x, float y, float z, float t)
+{
+	const float F4 = 0.309016994; // (sqrt(5)-1)/4
+	const float G4 = 0.138196601; // (5-sqrt(5))/20
+
+	vec4 p = vec4(x, y, z, t);
+	vec4 cell = floor(p + (p.x + p.y + p.z + p.w) * F4);
+	vec4 d0 = p - (cell - (cell.x + cell.y + cell.z + cell.w) * G4);
+
+	// rank of each axis by offset: the simplex steps along the largest first
+	vec4 rank;
+	vec3 isX = step(d0.yzw, d0.xxx);
+	rank.x = isX.x + isX.y + isX.z;
+	rank.yzw = 1.0 - isX;
+	vec2 isY = step(d0.zw, d0.yy);
+	rank.y += isY.x + isY.y;
+	rank.zw += 1.0 - isY;
+	float isZ = step(d0.w, d0.z);
+	rank.z += isZ;
+	rank.w += 1.0 - isZ;
+
+	vec4 i1 = clamp(rank - 2.0, 0.0, 1.0);
+	vec4 i2 = clamp(rank - 1.0, 0.0, 1.0);
+	vec4 i3 = clamp(rank, 0.0, 1.0);
+	ivec4 c = ivec4(cell);
+
+	float n = SimplexCorner(c, d0)
+		+ SimplexCorner(c + ivec4(i1), d0 - i1 + G4)
+		+ SimplexCorner(c + ivec4(i2), d0 - i2 + 2.0 * G4)
+		+ SimplexCorner(c + ivec4(i3), d0 - i3 + 3.0 * G4)
+		+ SimplexCorner(c + ivec4(1), d0 - 1.0 + 4.0 * G4);
+	return 27.0 * n;
+}
+
 float PerlinNoise_4D(float x, float y, float z, float t)
 {	
   float p = persistence;
@@ -119,7 +188,10 @@ float PerlinNoise_4D(float x, float y, float z, float t)
   float total = 0;
   for (int i=0; i<=n; i++)	{
 
-	  total += InterpolatedNoise4D(x * frequency, y * frequency, z*frequency, t*frequency) * amplitude;
+	  if (basis == 1)
+		  total += SimplexNoise4D(x * frequency, y * frequency, z*frequency, t*frequency) * amplitude;
+	  else
+		  total += InterpolatedNoise4D(x * frequency, y * frequency, z*frequency, t*frequency) * amplitude;
 
     frequency *= 2.0;
     amplitude *= p;	 
@@ -157,6 +229,12 @@ void main(void) {
 
 	gl_FragColor += vec4(LightContribution.xyz, 1);
 
+	// solid mode: the triangle edges in black, where a barycentric
+	// coordinate gets within a pixel of 0
+	if (wireframe) {
+		vec3 edge = smoothstep (vec3 (0.0), fwidth (barycentric), barycentric);
+		gl_FragColor.rgb *= min (min (edge.x, edge.y), edge.z);
+	}
 
 }
 
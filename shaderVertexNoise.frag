@@ -0,0 +1,76 @@
+// --------------------------------------------------------------------------
+// gMini,
+// a minimal Glut/OpenGL app to extend                              
+//
+// Copyright(C) 2007-2009                
+// Tamy Boubekeur
+//                                                                            
+// All rights reserved.                                                       
+//                                                                            
+// This program is free software; you can redistribute it and/or modify       
+// it under the terms of the GNU General Public License as published by       
+// the Free Software Foundation; either version 2 of the License, or          
+// (at your option) any later version.                                        
+//                                                                            
+// This program is distributed in the hope that it will be useful,            
+// but WITHOUT ANY WARRANTY; without even the implied warranty of             
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              
+// GNU General Public License (http://www.gnu.org/licenses/gpl.txt)           
+// for more details.                                                          
+//                                                                          
+// --------------------------------------------------------------------------
+
+// the shading of the noise shaders, with the noise interpolated from the vertices
+
+varying vec4 P;
+varying vec3 N;
+varying float noise;
+
+// phong brdf parameters
+uniform float diffuseRef;
+uniform float specRef;
+uniform float shininess;
+uniform bool wireframe;
+varying vec3 barycentric;
+
+uniform int noiseType; // 0: perlin, 1: wavelet, 2: gabor
+
+void main(void) {
+	gl_FragColor = vec4 (0.0, 0.0, 0.0, 1);
+
+	vec3 c1 = vec3(0.7, 0.7, 0.7); // shiny grey
+	vec3 c2 = vec3(0.0, 0.0, 0.0); // white
+	vec3 p = vec3 (gl_ModelViewMatrix * P);
+
+	if (noiseType == 0) {
+		// shaderPerlin.frag
+		float c = (noise + 1.0)/2.0;
+		float value = 1.0 - sqrt(abs(sin(2.0 * 3.141592 *c)));
+		gl_FragColor.rgb += vec3(c1.b * (1.0 - value) + c2.b * value);
+	} else {
+		// shaderWavelet.frag, shaderGabor.frag
+		gl_FragColor.rgb += noise;
+	}
+
+	// BRDF
+	vec3 n = normalize (gl_NormalMatrix * N);
+	vec3 l = normalize (gl_LightSource[0].position.xyz - p);
+
+	vec3 r = reflect (-l, n);
+	vec3 v = normalize (-p);
+
+	float diffuse = max(0.0,dot(n, l));
+	float spec = pow(max(0.0, dot(r, v)), shininess);
+
+	vec4 LightContribution =  diffuseRef * diffuse * gl_LightSource[0].diffuse + 
+		specRef * spec * gl_LightSource[0].specular;
+
+	gl_FragColor += vec4(LightContribution.xyz, 1);
+
+	// solid mode: the triangle edges in black, where a barycentric
+	// coordinate gets within a pixel of 0
+	if (wireframe) {
+		vec3 edge = smoothstep (vec3 (0.0), fwidth (barycentric), barycentric);
+		gl_FragColor.rgb *= min (min (edge.x, edge.y), edge.z);
+	}
+}
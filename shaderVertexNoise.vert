@@ -0,0 +1,42 @@
+// --------------------------------------------------------------------------
+// gMini,
+// a minimal Glut/OpenGL app to extend                              
+//
+// Copyright(C) 2007-2009                
+// Tamy Boubekeur
+//                                                                            
+// All rights reserved.                                                       
+//                                                                            
+// This program is free software; you can redistribute it and/or modify       
+// it under the terms of the GNU General Public License as published by       
+// the Free Software Foundation; either version 2 of the License, or          
+// (at your option) any later version.                                        
+//                                                                            
+// This program is distributed in the hope that it will be useful,            
+// but WITHOUT ANY WARRANTY; without even the implied warranty of             
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the              
+// GNU General Public License (http://www.gnu.org/licenses/gpl.txt)           
+// for more details.                                                          
+//                                                                          
+// --------------------------------------------------------------------------
+
+// noise evaluated on the CPU, one value per vertex
+
+attribute float noiseValue;
+attribute vec3 barycentricCoords;
+
+varying vec4 P;
+varying vec3 N;
+varying float noise;
+varying vec3 barycentric;
+
+void main(void)
+{
+    P = gl_Vertex;
+    N = gl_Normal;
+    noise = noiseValue;
+    barycentric = barycentricCoords;
+
+    gl_Position = ftransform ();
+    gl_FrontColor = gl_Color;
+}
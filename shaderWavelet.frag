@@ -30,6 +30,8 @@ varying vec3 N;
 uniform float diffuseRef;
 uniform float specRef;
 uniform float shininess;
+uniform bool wireframe;
+varying vec3 barycentric;
 
 // wavelet properties
 float noiseData[4*4*4] = {0.196901,0.226127,0.73559,-0.19617,0.232854,0.542263,-0.326628,0.115312,0.382126,-0.251225,-0.194003,-0.139241,0.0292745,-0.286176,-0.340949,0.322836,0.00314856,0.0181928,-0.410858,-0.364563,-0.415781,0.184471,0.668723,-0.21028,0.417364,-0.0364163,-0.0772177,-0.200269,-0.552198,0.202988,-0.00685827,0.378057,-0.222047,-0.628905,0.414194,0.379778,0.0611332,-0.288577,0.417755,-0.48197,0.0599536,0.6066,-0.487573,-0.191867,-0.168617,0.0132412,0.30492,-0.131832,-0.509103,-0.0795462,-0.137075,0.57419,0.287148,0.417486,-0.319362,0.593332,-0.460702,-0.130681,0.27446,0.428837,-0.391115,-0.205771,-0.170539,-0.475143};
@@ -180,6 +182,12 @@ void main(void) {
 
 	gl_FragColor += vec4(LightContribution.xyz, 1 + noiseData[0]/1000);
 
+	// solid mode: the triangle edges in black, where a barycentric
+	// coordinate gets within a pixel of 0
+	if (wireframe) {
+		vec3 edge = smoothstep (vec3 (0.0), fwidth (barycentric), barycentric);
+		gl_FragColor.rgb *= min (min (edge.x, edge.y), edge.z);
+	}
 
 }
 